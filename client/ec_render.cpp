@@ -66,9 +66,23 @@ void EC_RenderModel::parts(ModelEffect effect, const ParticleBatchPars& pars)
 {
 	ent.ref<EC_RenderPos>().parts({model, effect}, pars);
 }
-void EC_RenderModel::render(const EC_RenderPos& p, TimeSpan)
+struct EC_RenderModel::Proxy : EC_RenderProxy
 {
-	RenAAL::get().draw_inst(p.get_cur(), clr, model);
+	ModelType model;
+	FColor clr;
+	
+	void render(const Transform& pos, TimeSpan) override
+	{
+		RenAAL::get().draw_inst(pos, clr, model);
+	}
+	bool allow_immediate_rotation() override {return true;}
+};
+std::unique_ptr<EC_RenderProxy> EC_RenderModel::proxy()
+{
+	auto p = std::make_unique<Proxy>();
+	p->model = model;
+	p->clr = clr;
+	return p;
 }
 
 
@@ -80,13 +94,24 @@ void EC_RenderEquip::attach(AttachType type, Transform at, ModelType model, FCol
 	a.at = at;
 	a.clr = clr;
 }
-void EC_RenderEquip::render(const EC_RenderPos& p, TimeSpan)
+struct EC_RenderEquip::Proxy : EC_RenderProxy
 {
-	auto& tr = p.get_cur();
-	for (auto& a : atts) {
-		if (a.model != MODEL_NONE)
-			RenAAL::get().draw_inst(tr.get_combined(a.at), a.clr, a.model);
+	std::array<Attach, ATT_TOTAL_COUNT_INTERNAL> atts;
+	
+	void render(const Transform& pos, TimeSpan) override
+	{
+		for (auto& a : atts) {
+			if (a.model != MODEL_NONE)
+				RenAAL::get().draw_inst(pos.get_combined(a.at), a.clr, a.model);
+		}
 	}
+	bool allow_immediate_rotation() override {return true;}
+};
+std::unique_ptr<EC_RenderProxy> EC_RenderEquip::proxy()
+{
+	auto p = std::make_unique<Proxy>();
+	p->atts = atts;
+	return p;
 }
 
 
@@ -133,18 +158,18 @@ std::unique_ptr<EC_ParticleEmitter::Channel> EC_ParticleEmitter::new_channel()
 {
 	return std::unique_ptr<Channel>(chs.new_ref());
 }
-void EC_ParticleEmitter::render(const EC_RenderPos& p, TimeSpan passed)
+void EC_ParticleEmitter::on_sync()
 {
 	auto proc = [&](Emit& e)
 	{
 		if (e.tmo.is_positive()) {
-			e.tmo -= passed;
+			e.tmo -= GameCore::step_len;
 			return true;
 		}
 		
 		e.tmo += e.period;
-		e.pars.tr = p.get_cur().get_combined(e.tr);
-		e.gen->draw(e.pars);
+		e.pars.tr = e.tr; // combined with entity transform by presenter
+		GamePresenter::get()->add_cmd(PresCmdParticles{ ent.index, e.gen, e.pars });
 		
 		if (!e.left) return false;
 		--e.left;
@@ -170,20 +195,71 @@ void EC_ParticleEmitter::resource_reinit_hack()
 
 
 
-void EC_LaserDesigRay::set_target(vec2fp new_tar)
+struct EC_LaserDesigRay::Proxy : EC_RenderProxy
 {
-	auto cur =ent.ref<EC_RenderPos>().get_cur().pos;
-	float ad = (new_tar - cur).angle() - (tar_ray - cur).angle();
+	FColor clr;
+	bool enabled;
+	float radius;
+	vec2fp tar; ///< Newest target
+	bool tar_lerp;
+	uint32_t tar_seq;
 	
-	if (std::fabs(wrap_angle(ad)) < deg_to_rad(25))
+	// render state
+	vec2fp ray;
+	std::optional<std::pair<vec2fp, vec2fp>> next;
+	float next_t;
+	
+	void render(const Transform& pos, TimeSpan passed) override
+	{
+		if (!enabled) return;
+		vec2fp src = pos.pos;
+		
+		vec2fp dt = ray - src;
+		dt.norm_to( radius );
+		
+		RenAAL::get().draw_line(src + dt, ray, clr.to_px(), 0.06, 1.f, std::max(clr.a, 1.f));
+		
+		if (next) {
+			next_t += passed / GameCore::step_len;
+			if (next_t < 1) {
+				ray = lerp(next->first, next->second, next_t);
+			}
+			else {
+				ray = next->second;
+				next.reset();
+			}
+		}
+	}
+	void on_vport_enter() override
 	{
-		tar_next = {tar_ray, new_tar};
-		tar_next_t = 0;
+		next.reset();
 	}
-	else {
-		tar_next.reset();
-		tar_ray = new_tar;
+	void take_state(EC_RenderProxy& prev_base) override
+	{
+		auto& prev = static_cast<Proxy&>(prev_base);
+		ray = prev.ray;
+		next = prev.next;
+		next_t = prev.next_t;
+		
+		if (prev.tar_seq == tar_seq) return;
+		if (tar_lerp) {
+			next = {ray, tar};
+			next_t = 0;
+		}
+		else {
+			next.reset();
+			ray = tar;
+		}
 	}
+};
+void EC_LaserDesigRay::set_target(vec2fp new_tar)
+{
+	auto cur = ent.ref<EC_RenderPos>().get_cur().pos;
+	float ad = (new_tar - cur).angle() - (tar_ray - cur).angle();
+	
+	tar_lerp = std::fabs(wrap_angle(ad)) < deg_to_rad(25);
+	tar_ray = new_tar;
+	++tar_seq;
 }
 void EC_LaserDesigRay::find_target(vec2fp dir)
 {
@@ -197,62 +273,103 @@ void EC_LaserDesigRay::find_target(vec2fp dir)
 	else
 		set_target(spos + dir * 1.5f);
 }
-void EC_LaserDesigRay::render(const EC_RenderPos& ecp, TimeSpan passed)
+std::unique_ptr<EC_RenderProxy> EC_LaserDesigRay::proxy()
 {
-	tmp_cull(cull_state, enabled);
-	if (!enabled) return;
-	vec2fp src = ecp.get_cur().pos;
-	
-	vec2fp dt = tar_ray - src;
-	dt.norm_to( ent.ref_pc().get_radius() );
-	
-	RenAAL::get().draw_line(src + dt, tar_ray, clr.to_px(), 0.06, 1.f, std::max(clr.a, 1.f));
-	
-	if (tar_next) {
-		float d = passed.seconds() / ent.core.step_len.seconds();
-		tar_next_t += d;
-		if (tar_next_t < 1) {
-			tar_ray = lerp(tar_next->first, tar_next->second, tar_next_t);
-		}
-		else {
-			tar_ray = tar_next->second;
-			tar_next.reset();
-		}
-	}
+	auto p = std::make_unique<Proxy>();
+	p->clr = clr;
+	p->enabled = enabled;
+	p->radius = ent.ref_pc().get_radius();
+	p->tar = tar_ray;
+	p->tar_lerp = tar_lerp;
+	p->tar_seq = tar_seq;
+	p->ray = tar_ray;
+	return p;
 }
 
 
 
+struct EC_Uberray::Proxy : EC_RenderProxy
+{
+	FColor clr;
+	TimeSpan left_max;
+	vec2fp b_last;
+	uint32_t trig_seq;
+	
+	TimeSpan left; // render state
+	
+	void render(const Transform& pos, TimeSpan passed) override
+	{
+		if (!left.is_positive()) return;
+		
+		vec2fp a = pos.pos;
+		vec2fp b = b_last;
+		
+		if (left < left_max) {
+			vec2fp v((b - a).fastlen() * (left / left_max), 0);
+			v.fastrotate( pos.rot );
+			b = a + v;
+		}
+		left -= passed;
+		
+		float ta = time_sine(TimeSpan::seconds(2), 0.85);
+		RenAAL::get().draw_line(a, b, clr.to_px() | 0xff, 0.2, 4, left / left_max * clr.a * ta);
+	}
+	void on_vport_enter() override
+	{
+		left = {};
+	}
+	void take_state(EC_RenderProxy& prev_base) override
+	{
+		auto& prev = static_cast<Proxy&>(prev_base);
+		left = (prev.trig_seq == trig_seq) ? prev.left : left_max;
+	}
+};
 void EC_Uberray::trigger(vec2fp target)
 {
 	left = left_max;
 	b_last = target;
+	++trig_seq;
+}
+std::unique_ptr<EC_RenderProxy> EC_Uberray::proxy()
+{
+	auto p = std::make_unique<Proxy>();
+	p->clr = clr;
+	p->left_max = left_max;
+	p->b_last = b_last;
+	p->trig_seq = trig_seq;
+	p->left = left;
+	return p;
 }
-void EC_Uberray::render(const EC_RenderPos& p, TimeSpan passed)
+void EC_Uberray::on_sync()
 {
 	tmp_cull(cull_state, left.is_positive());
-	if (!left.is_positive()) return;
-	
-	vec2fp a = p.get_cur().pos;
-	vec2fp b = b_last;
-	
-	if (left < left_max) {
-		vec2fp v((b - a).fastlen() * (left / left_max), 0);
-		v.fastrotate( p.get_cur().rot );
-		b = a + v;
-	}
-	left -= passed;
-	
-	float ta = time_sine(TimeSpan::seconds(2), 0.85);
-	RenAAL::get().draw_line(a, b, clr.to_px() | 0xff, 0.2, 4, left / left_max * clr.a * ta);
+	left -= GameCore::step_len;
 }
 
 
 
-void EC_RenderDoor::render(const EC_RenderPos& p, TimeSpan)
+struct EC_RenderDoor::Proxy : EC_RenderProxy
+{
+	vec2fp fix_he;
+	bool is_x_ext;
+	FColor l_clr;
+	float t_ext;
+	
+	void render(const Transform& pos, TimeSpan) override;
+};
+std::unique_ptr<EC_RenderProxy> EC_RenderDoor::proxy()
+{
+	auto p = std::make_unique<Proxy>();
+	p->fix_he = fix_he;
+	p->is_x_ext = is_x_ext;
+	p->l_clr = l_clr;
+	p->t_ext = t_ext;
+	return p;
+}
+void EC_RenderDoor::Proxy::render(const Transform& pos, TimeSpan)
 {
-	vec2fp p0 = p.get_cur().pos - fix_he;
-	vec2fp p1 = p.get_cur().pos + fix_he;
+	vec2fp p0 = pos.pos - fix_he;
+	vec2fp p1 = pos.pos + fix_he;
 	
 	vec2fp o_len, o_wid; // offsets
 	if (is_x_ext)
@@ -287,6 +404,23 @@ void EC_RenderDoor::render(const EC_RenderPos& p, TimeSpan)
 
 
 
+struct EC_RenderCustomDebug::Proxy : EC_RenderProxy
+{
+	std::function<void(Transform pos, TimeSpan passed)> f;
+	
+	void render(const Transform& pos, TimeSpan passed) override {
+		if (f) f(pos, passed);
+	}
+};
+std::unique_ptr<EC_RenderProxy> EC_RenderCustomDebug::proxy()
+{
+	auto p = std::make_unique<Proxy>();
+	p->f = f;
+	return p;
+}
+
+
+
 EC_LightSource::EC_LightSource(Entity& ent): EDynComp(ent) {}
 EC_LightSource::~EC_LightSource() = default;
 void EC_LightSource::add(vec2fp offset, float angle, FColor clr, float radius) {
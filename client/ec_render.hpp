@@ -11,12 +11,11 @@ struct RenLightRef;
 
 struct EC_RenderPos : EDynComp
 {
-	static constexpr int interp_depth = 3;
 	int8_t disable_culling = 0; ///< If true, never culled (counter for use by components)
 	bool immediate_rotation = false; ///< If true, rotation isn't interpolated (only for some components)
 	
+	/// Position at last sync. Interpolated one is known only to render thread (GamePresenter::get_render_pos)
 	const Transform& get_cur() const {return pos;}
-	const Transform& newest() const {return fn ? fs[fn-1].second : pos;}
 	bool is_visible_now() const {return in_vport;}
 	
 	EC_RenderPos(Entity& ent);
@@ -28,11 +27,19 @@ private:
 	
 	Transform pos;
 	bool in_vport = true; 
-	
-	std::array<std::pair<TimeSpan, Transform>, interp_depth> fs;
-	int fn = 0;
-	
-	vec2fp vel = {};
+};
+
+
+
+/// Copy of EC_RenderComp state, owned by render thread. 
+/// New copy is made on each sync while entity is visible
+struct EC_RenderProxy
+{
+	virtual ~EC_RenderProxy() = default;
+	virtual void render(const Transform& pos, TimeSpan passed) = 0;
+	virtual bool allow_immediate_rotation() {return false;}
+	virtual void on_vport_enter() {} ///< Called when stops being culled
+	virtual void take_state(EC_RenderProxy&) {} ///< Called with previous copy of same component
 };
 
 
@@ -44,11 +51,13 @@ protected:
 	~EC_RenderComp();
 	
 	friend class GamePresenter_Impl;
-	virtual void render(const EC_RenderPos& p, TimeSpan passed) = 0;
-	virtual bool allow_immediate_rotation() {return false;}
-	virtual void on_vport_enter() {} ///< Called when stops being culled
+	virtual std::unique_ptr<EC_RenderProxy> proxy() = 0; ///< Copies state for rendering. May return null
+	virtual void on_sync() {} ///< Called on each sync while visible, before proxy()
 	
 	void tmp_cull(bool& state, bool disable_culling);
+	
+private:
+	uint32_t ren_id = 0; ///< Set by presenter
 };
 
 
@@ -72,8 +81,8 @@ struct EC_RenderModel : EC_RenderComp
 	void parts(ModelEffect effect, const ParticleBatchPars& pars);
 	
 private:
-	void render(const EC_RenderPos& p, TimeSpan passed);
-	bool allow_immediate_rotation() {return true;}
+	struct Proxy;
+	std::unique_ptr<EC_RenderProxy> proxy();
 };
 
 
@@ -101,8 +110,8 @@ private:
 	};
 	std::array<Attach, ATT_TOTAL_COUNT_INTERNAL> atts;
 	
-	void render(const EC_RenderPos& p, TimeSpan passed);
-	bool allow_immediate_rotation() {return true;}
+	struct Proxy;
+	std::unique_ptr<EC_RenderProxy> proxy();
 };
 
 
@@ -156,7 +165,8 @@ private:
 	std::vector<Emit> ems;
 	SubresRoot<Channel, EC_ParticleEmitter> chs;
 	
-	void render(const EC_RenderPos& p, TimeSpan passed);
+	std::unique_ptr<EC_RenderProxy> proxy() {return {};}
+	void on_sync(); ///< Emits particles
 };
 
 
@@ -175,12 +185,13 @@ struct EC_LaserDesigRay : EC_RenderComp
 	
 private:
 	vec2fp tar_ray = {};
-	std::optional<std::pair<vec2fp, vec2fp>> tar_next;
-	float tar_next_t;
+	bool tar_lerp = false; ///< Move smoothly from previous target
+	uint32_t tar_seq = 0; ///< Incremented on each target change
 	bool cull_state = false;
 	
-	void render(const EC_RenderPos& p, TimeSpan passed);
-	void on_vport_enter() {tar_next.reset();}
+	struct Proxy;
+	std::unique_ptr<EC_RenderProxy> proxy();
+	void on_sync() {tmp_cull(cull_state, enabled);}
 };
 
 
@@ -195,12 +206,14 @@ struct EC_Uberray : EC_RenderComp
 	void trigger(vec2fp target);
 	
 private:
-	TimeSpan left;
+	TimeSpan left; ///< Only for culling
 	vec2fp b_last = {};
+	uint32_t trig_seq = 0; ///< Incremented on each trigger
 	bool cull_state = false;
 	
-	void render(const EC_RenderPos& p, TimeSpan passed);
-	void on_vport_enter() {left = {};}
+	struct Proxy;
+	std::unique_ptr<EC_RenderProxy> proxy();
+	void on_sync();
 };
 
 
@@ -220,21 +233,21 @@ private:
 	FColor l_clr; // alpha is ignored
 	float t_ext = 1;
 	
-	void render(const EC_RenderPos& p, TimeSpan passed);
+	struct Proxy;
+	std::unique_ptr<EC_RenderProxy> proxy();
 };
 
 
 
 struct EC_RenderCustomDebug : EC_RenderComp
 {
-	std::function<void(Transform pos, TimeSpan passed)> f;
+	std::function<void(Transform pos, TimeSpan passed)> f; ///< Copied on each sync and called in render thread
 	EC_RenderCustomDebug(Entity& ent, std::function<void(Transform pos, TimeSpan passed)> f)
 		: EC_RenderComp(ent), f(std::move(f)) {}
 	
 private:
-	void render(const EC_RenderPos& p, TimeSpan passed) {
-		if (f) f(p.get_cur(), passed);
-	}
+	struct Proxy;
+	std::unique_ptr<EC_RenderProxy> proxy();
 };
 
 
@@ -1,3 +1,5 @@
+#include <mutex>
+#include <unordered_map>
 #include "core/settings.hpp"
 #include "game/game_core.hpp"
 #include "game/level_gen.hpp"
@@ -77,31 +79,138 @@ public:
 		}
 	};
 	
+	/// State copied by sync for render thread
+	struct Snapshot
+	{
+		struct Ent
+		{
+			uint32_t eid; ///< Entity index
+			uint32_t ren_id; ///< Differs for entities created with same index
+			Transform tr;
+			vec2fp vel;
+			bool reset; ///< Entered viewport, interpolation must be reset
+			bool immediate_rotation;
+			uint32_t comp_first, comp_count; ///< Range in comps
+		};
+		struct Comp
+		{
+			uint32_t ren_id;
+			std::unique_ptr<EC_RenderProxy> p;
+		};
+		
+		TimeSpan frame_time;
+		bool playback;
+		size_t n_total, n_synced; ///< Debug info
+		
+		std::vector<Ent> ents; ///< Only visible
+		std::vector<Comp> comps;
+		
+		std::vector<PresCmdDbgRect> dbg_rs;
+		std::vector<PresCmdDbgLine> dbg_ls;
+		std::vector<PresCmdDbgText> dbg_ts;
+		
+		// accumulated until taken by render thread
+		std::vector<PartDelay> parts;
+		std::vector<std::unique_ptr<GameRenderEffect>> effs;
+		std::vector<FloatTextRender> texts;
+	};
+	
+	static constexpr int interp_depth = 3; ///< Max frames
+	
+	/// Entity state owned by render thread
+	struct RenEnt
+	{
+		uint32_t ren_id;
+		uint32_t stamp; ///< Last snapshot in which was present
+		
+		Transform pos;
+		std::array<std::pair<TimeSpan, Transform>, interp_depth> fs;
+		int fn = 0;
+		vec2fp vel;
+		float rot; ///< Newest, for immediate rotation
+		bool immediate_rotation;
+		
+		std::vector<EC_RenderProxy*> comps;
+	};
+	struct RenComp
+	{
+		uint32_t stamp;
+		std::unique_ptr<EC_RenderProxy> p;
+	};
+	
 	GameCore* core;
 	const LevelTerrain* terrain;
-	std::vector<PresCommand> cmds_queue;
-	std::vector<PartDelay> part_del;
 	
-	std::vector<PresCmdDbgRect> dbg_rs, dbg_rs_new;
-	std::vector<PresCmdDbgLine> dbg_ls, dbg_ls_new;
-	std::vector<PresCmdDbgText> dbg_ts, dbg_ts_new;
-	SparseArray<std::unique_ptr<GameRenderEffect>> ef_fs;
-	std::vector<FloatTextRender> f_texts;
+	// logic thread
+	
+	std::vector<PresCommand> cmds_queue;
+	std::vector<PartDelay> part_new;
+	std::vector<PresCmdDbgRect> dbg_rs_new;
+	std::vector<PresCmdDbgLine> dbg_ls_new;
+	std::vector<PresCmdDbgText> dbg_ts_new;
+	std::vector<std::unique_ptr<GameRenderEffect>> effs_new;
+	std::vector<FloatTextRender> texts_new;
 	
 	struct EntReg
 	{
 		EC_RenderPos* pos = {};
 		std::vector<EC_RenderComp*> subs;
+		uint32_t ren_id;
+		
+		int cell = -1; ///< Index in culling grid
+		uint32_t cell_slot; ///< Index in cell list
+		uint32_t stamp = 0; ///< Last sync in which was processed
+		bool in_vis = false; ///< Is in vis_list
 	};
 	
 	std::vector<EntReg> regs;
+	size_t regs_count = 0; // non-empty
+	uint32_t ren_id_last = 0;
+	
+	// culling grid - entities are placed by last synced position
+	static constexpr float grid_cell = 16; ///< Cell size, meters
+	static constexpr float cull_margin = 16; ///< Covers movement of entities between cell refreshes
+	static constexpr size_t refresh_steps = 8; ///< All cells are refreshed in that many steps
+	static constexpr size_t refresh_min = 64; ///< Minimal number of entities refreshed per step
+	
+	vec2i grid_size;
+	std::vector<std::vector<uint32_t>> grid; ///< Indices of regs
+	size_t refresh_i = 0;
+	uint32_t sync_stamp = 0;
+	std::vector<uint32_t> proc_list; ///< Temporary
+	std::vector<uint32_t> vis_list; ///< Visible after last sync or added after it
+	
+	// shared
+	
+	TripleBuffer<Snapshot> snaps;
+	bool snap_stale = false; ///< Back snapshot was published, but never taken (logic thread)
+	std::vector<uint32_t> stale_resets; ///< Temporary (logic thread)
+	
+	std::mutex vport_lock;
+	Rectfp vport_pub; ///< Protected by vport_lock
+	
+	// render thread
+	
+	std::unordered_map<uint32_t, RenEnt> r_ents; ///< By entity index
+	std::unordered_map<uint32_t, RenComp> r_comps; ///< By component ren_id
+	std::vector<RenEnt*> r_vis; ///< In snapshot order
+	uint32_t r_stamp = 0;
+	
+	std::vector<PartDelay> part_del;
+	std::vector<PresCmdDbgRect> dbg_rs;
+	std::vector<PresCmdDbgLine> dbg_ls;
+	std::vector<PresCmdDbgText> dbg_ts;
+	SparseArray<std::unique_ptr<GameRenderEffect>> ef_fs;
+	std::vector<FloatTextRender> f_texts;
+	
 	TimeSpan last_passed;
 	TimeSpan prev_frame;
 	
 	vec2fp vport_offset = {10, 10}; ///< Occlusion rect size offset
-	std::optional<std::pair<int, ImageInfo>> dbg_sshot_img;
+	std::optional<std::pair<bool, ImageInfo>> dbg_sshot_img; ///< Flag is true if image is requested
 	
 	int max_interp_frames = 0;
+	size_t dbg_total = 0, dbg_synced = 0;
 	RAII_Guard menu_g;
 	
 	
@@ -112,59 +221,106 @@ public:
 		terrain = pars.lvl;
 		reinit_resources(*terrain);
 		
+		grid_size = (vec2fp(terrain->grid_size) * GameConst::cell_size / grid_cell).int_ceil();
+		grid_size = {std::max(grid_size.x, 1), std::max(grid_size.y, 1)};
+		grid.resize(grid_size.area());
+		
 		menu_g = vig_reg_menu(VigMenu::DebugRenderer, [this]{
 			vig_label_a("Interp frames (max): {}\n", max_interp_frames);
+			vig_label_a("Render objects: {} visible / {} total, {} synced\n", r_vis.size(), dbg_total, dbg_synced);
 		});
 	}
 	void sync(TimeSpan now) override
 	{
-		dbg_rs.clear(); dbg_rs.swap(dbg_rs_new);
-		dbg_ls.clear(); dbg_ls.swap(dbg_ls_new);
-		dbg_ts.clear(); dbg_ts.swap(dbg_ts_new);
+		auto t0 = TimeSpan::current();
+		auto& snap = snaps.back();
+		
+		// resets from snapshot which render thread skipped
+		stale_resets.clear();
+		if (snap_stale) {
+			for (auto& e : snap.ents) if (e.reset) stale_resets.push_back(e.ren_id);
+			std::sort(stale_resets.begin(), stale_resets.end());
+		}
+		snap.ents.clear();
+		snap.comps.clear();
+		
+		snap.dbg_rs.clear(); snap.dbg_rs.swap(dbg_rs_new);
+		snap.dbg_ls.clear(); snap.dbg_ls.swap(dbg_ls_new);
+		snap.dbg_ts.clear(); snap.dbg_ts.swap(dbg_ts_new);
 		
 		//
 		
-		TimeSpan frame_time = now + GameCore::step_len;
-		int interp_dep = AppSettings::get().interp_depth;
+		snap.frame_time = now + GameCore::step_len;
+		snap.playback = playback_hack;
 		
-		Rectfp vport = vport_rect();
-		for (auto& ei : regs)
+		++sync_stamp;
+		proc_list.clear();
+		auto mark = [&](uint32_t i) {
+			auto& ei = regs[i];
+			if (ei.pos && ei.stamp != sync_stamp) {
+				ei.stamp = sync_stamp;
+				proc_list.push_back(i);
+			}
+		};
+		
+		// update cells of some entities, so moving off-screen ones aren't lost
+		size_t n_refresh = std::min(regs.size(), std::max(refresh_min, regs.size() / refresh_steps));
+		for (; n_refresh; --n_refresh, ++refresh_i)
 		{
+			if (refresh_i >= regs.size()) refresh_i = 0;
+			auto& ei = regs[refresh_i];
 			if (!ei.pos) continue;
 			
+			grid_move(refresh_i, ei.pos->ent.get_pos());
+			if (ei.pos->disable_culling) mark(refresh_i);
+		}
+		
+		// collect visible and possibly visible
+		for (auto i : vis_list) {
+			regs[i].in_vis = false;
+			mark(i);
+		}
+		
+		Rectfp vport = get_vport();
+		Rect vcells = grid_cells(Rectfp::bounds(vport.lower() - vec2fp::one(cull_margin), vport.upper() + vec2fp::one(cull_margin)));
+		vcells.map([&](vec2i p){
+			for (auto i : grid[p.y * grid_size.x + p.x]) mark(i);
+		});
+		
+		vis_list.clear();
+		snap.n_total = regs_count;
+		snap.n_synced = proc_list.size();
+		
+		for (auto i : proc_list)
+		{
+			auto& ei = regs[i];
 			EC_RenderPos& c = *ei.pos;
 			Transform tr = c.ent.ref_pc().get_trans();
+			grid_move(i, tr.pos);
+			c.pos = tr;
 			
 			bool was_vp = c.in_vport;
 			c.in_vport = c.disable_culling || vport.contains( tr.pos );
 			if (!c.in_vport) continue;
 			
-			if (interp_dep)
-			{
-				if (!was_vp || playback_hack) {
-					c.pos = tr;
-					c.fn = 0;
-				}
-				else {
-					if (!c.fn) c.fs[c.fn++] = { prev_frame, c.pos };
-					if (c.fs[c.fn-1].first >= frame_time) {
-						c.fs[c.fn-1].second = tr;
-					}
-					else {
-						if (c.fn >= interp_dep) c.fn = interp_dep - 1;
-						c.fs[c.fn++] = { frame_time, tr };
-					}
-				}
-			}
-			else {
-				c.pos = tr;
-				c.vel = c.ent.ref_pc().get_vel();
-			}
+			ei.in_vis = true;
+			vis_list.push_back(i);
+			
+			auto& se = snap.ents.emplace_back();
+			se.eid = i;
+			se.ren_id = ei.ren_id;
+			se.tr = tr;
+			se.vel = c.ent.ref_pc().get_vel();
+			se.reset = !was_vp || std::binary_search(stale_resets.begin(), stale_resets.end(), ei.ren_id);
+			se.immediate_rotation = c.immediate_rotation;
 			
-			if (!was_vp) {
-				for (auto& sub : ei.subs)
-					sub->on_vport_enter();
+			se.comp_first = snap.comps.size();
+			for (auto& sub : ei.subs) {
+				sub->on_sync();
+				if (auto p = sub->proxy())
+					snap.comps.push_back({ sub->ren_id, std::move(p) });
 			}
+			se.comp_count = snap.comps.size() - se.comp_first;
 		}
 		
 		//
@@ -176,7 +332,7 @@ public:
 				{
 					if (!c.gen) return;
 
-					auto& pd = part_del.emplace_back();
+					auto& pd = snap.parts.emplace_back();
 					pd.gen = c.gen;
 					pd.pars = c.pars;
 
@@ -190,27 +346,17 @@ public:
 		}
 		cmds_queue.clear();
 		
-		//
+		snap.parts.insert(snap.parts.end(), part_new.begin(), part_new.end());
+		part_new.clear();
 		
-		if (dbg_sshot_img)
-		{
-			if (dbg_sshot_img->first != 3) dbg_sshot_img->first |= 2;
-			else {
-				std::thread thr([](ImageInfo img)
-				{
-					set_this_thread_name("screenshot");
-					img.convert(ImageInfo::FMT_RGB);
-					img.vflip();
-					std::string s = FMT_FORMAT("debug_{}.png", date_time_fn());
-					img.save( s.data() );
-					VLOGI("Saved sshot: {}", s);
-				}
-				, std::move(dbg_sshot_img->second));
-
-				dbg_sshot_img = {};
-				thr.detach();
-			}
-		}
+		for (auto& e : effs_new) snap.effs.emplace_back(std::move(e));
+		effs_new.clear();
+		
+		for (auto& t : texts_new) snap.texts.emplace_back(std::move(t));
+		texts_new.clear();
+		
+		snap_stale = snaps.publish();
+		dbg_sync_time = TimeSpan::current() - t0;
 	}
 	void add_cmd(PresCommand c) override
 	{
@@ -220,6 +366,16 @@ public:
 	}
 	void render(TimeSpan now, TimeSpan passed) override
 	{
+		auto t0 = TimeSpan::current();
+		publish_vport();
+		
+		int interp_dep = AppSettings::get().interp_depth;
+		if (interp_dep > 2)
+			now -= GameCore::step_len; // +1 interp step (2 steps lag total)
+		
+		if (snaps.update())
+			take_snapshot(snaps.front(), interp_dep);
+		
 		for (auto& d : part_del) d.gen->draw(d.pars);
 		part_del.clear();
 		
@@ -227,20 +383,12 @@ public:
 		
 		//
 		
-		int interp_dep = AppSettings::get().interp_depth;
-		if (interp_dep > 2)
-			now -= GameCore::step_len; // +1 interp step (2 steps lag total)
-		
 		prev_frame = now;
 		max_interp_frames = 0;
 		
-		for (auto& ei : regs)
+		for (auto pc : r_vis)
 		{
-			if (!ei.pos) continue;
-			
-			EC_RenderPos& c = *ei.pos;
-			if (!c.is_visible_now()) continue;
-			
+			RenEnt& c = *pc;
 			if (interp_dep)
 			{
 				while (c.fn >= 2)
@@ -259,17 +407,13 @@ public:
 			max_interp_frames = std::max(max_interp_frames, c.fn);
 			
 			if (!c.immediate_rotation) {
-				for (auto& sub : ei.subs)
-					sub->render(c, passed);
+				for (auto& sub : c.comps)
+					sub->render(c.pos, passed);
 			}
 			else {
-				Transform orig {c.pos};
-				Transform imr {c.pos.pos, c.ent.ref_pc().get_angle()};
-				for (auto& sub : ei.subs) {
-					c.pos = sub->allow_immediate_rotation() ? imr : orig;
-					sub->render(c, passed);
-				}
-				c.pos = orig;
+				Transform imr {c.pos.pos, c.rot};
+				for (auto& sub : c.comps)
+					sub->render(sub->allow_immediate_rotation() ? imr : c.pos, passed);
 			}
 			
 			if (!interp_dep)
@@ -306,20 +450,139 @@ public:
 		
 		for (auto& d : dbg_ts) RenImm::get().draw_text(d.at, d.str, d.clr);
 		
-		if (dbg_sshot_img && dbg_sshot_img->first == 2)
+		if (dbg_sshot_img)
+		{
+			if (!dbg_sshot_img->first)
+			{
+				if (RenderControl::get().img_screenshot) {
+					VLOGW("GamePresenter::dbg_screenshot() ignored");
+					dbg_sshot_img = {};
+				}
+				else {
+					RenderControl::get().img_screenshot = &dbg_sshot_img->second;
+					dbg_sshot_img->first = true;
+				}
+			}
+			else // image was captured after previous frame
+			{
+				std::thread thr([](ImageInfo img)
+				{
+					set_this_thread_name("screenshot");
+					img.convert(ImageInfo::FMT_RGB);
+					img.vflip();
+					std::string s = FMT_FORMAT("debug_{}.png", date_time_fn());
+					img.save( s.data() );
+					VLOGI("Saved sshot: {}", s);
+				}
+				, std::move(dbg_sshot_img->second));
+
+				dbg_sshot_img = {};
+				thr.detach();
+			}
+		}
+		
+		dbg_render_time = TimeSpan::current() - t0;
+	}
+	void take_snapshot(Snapshot& s, int interp_dep)
+	{
+		++r_stamp;
+		r_vis.clear();
+		
+		for (auto& se : s.ents)
 		{
-			dbg_sshot_img->first |= 1;
-			if (RenderControl::get().img_screenshot) VLOGW("GamePresenter::dbg_screenshot() ignored");
-			else RenderControl::get().img_screenshot = &dbg_sshot_img->second;
+			auto [it, is_new] = r_ents.try_emplace(se.eid);
+			RenEnt& c = it->second;
+			
+			bool reset = se.reset || is_new || c.ren_id != se.ren_id;
+			c.ren_id = se.ren_id;
+			c.stamp = r_stamp;
+			c.vel = se.vel;
+			c.rot = se.tr.rot;
+			c.immediate_rotation = se.immediate_rotation;
+			
+			if (interp_dep)
+			{
+				if (reset || s.playback) {
+					c.pos = se.tr;
+					c.fn = 0;
+				}
+				else {
+					if (!c.fn) c.fs[c.fn++] = { prev_frame, c.pos };
+					if (c.fs[c.fn-1].first >= s.frame_time) {
+						c.fs[c.fn-1].second = se.tr;
+					}
+					else {
+						if (c.fn >= interp_dep) c.fn = interp_dep - 1;
+						c.fs[c.fn++] = { s.frame_time, se.tr };
+					}
+				}
+			}
+			else c.pos = se.tr;
+			
+			c.comps.clear();
+			for (uint32_t i = se.comp_first; i < se.comp_first + se.comp_count; ++i)
+			{
+				auto& sc = s.comps[i];
+				auto& rc = r_comps[sc.ren_id];
+				if (rc.p) sc.p->take_state(*rc.p);
+				rc.p = std::move(sc.p);
+				rc.stamp = r_stamp;
+				
+				if (reset) rc.p->on_vport_enter();
+				c.comps.push_back(rc.p.get());
+			}
+			r_vis.push_back(&c);
+		}
+		
+		// state of culled objects isn't kept
+		for (auto it = r_ents.begin(); it != r_ents.end(); ) {
+			if (it->second.stamp != r_stamp) it = r_ents.erase(it);
+			else ++it;
 		}
+		for (auto it = r_comps.begin(); it != r_comps.end(); ) {
+			if (it->second.stamp != r_stamp) it = r_comps.erase(it);
+			else ++it;
+		}
+		
+		dbg_rs.swap(s.dbg_rs);
+		dbg_ls.swap(s.dbg_ls);
+		dbg_ts.swap(s.dbg_ts);
+		
+		part_del.insert(part_del.end(), s.parts.begin(), s.parts.end());
+		s.parts.clear();
+		
+		for (auto& e : s.effs) ef_fs.emplace_new(std::move(e));
+		s.effs.clear();
+		
+		for (auto& t : s.texts) f_texts.emplace_back(std::move(t));
+		s.texts.clear();
+		
+		dbg_total = s.n_total;
+		dbg_synced = s.n_synced;
 	}
 	
 	TimeSpan get_passed() override {return last_passed;}
-	Rectfp   get_vport()  override {return vport_rect();}
+	Rectfp get_vport() override
+	{
+		std::unique_lock lock(vport_lock);
+		return vport_pub;
+	}
+	void publish_vport() override
+	{
+		Rectfp r = vport_rect();
+		std::unique_lock lock(vport_lock);
+		vport_pub = r;
+	}
+	std::optional<vec2fp> get_render_pos(EntityIndex eid) override
+	{
+		auto it = r_ents.find(eid.to_int());
+		if (it == r_ents.end()) return {};
+		return it->second.pos.pos;
+	}
 	
 	void dbg_screenshot() override
 	{
-		dbg_sshot_img = {0, {}};
+		dbg_sshot_img = {false, {}};
 	}
 	
 	void reinit_resources(const LevelTerrain& lvl)
@@ -333,10 +596,10 @@ public:
 		float kw_wall = 0.1, ka_wall = 3;
 		
 		for (auto& l : lvl.ls_grid) RenAAL::get().inst_add({l.first, l.second}, false, kw_grid, ka_grid);
-		RenAAL::get().inst_add_end();
+		RenAAL::get().inst_add_end(true);
 		
 		for (auto& l : lvl.ls_wall) RenAAL::get().inst_add(l, false, kw_wall, ka_wall);
-		RenAAL::get().inst_add_end();
+		RenAAL::get().inst_add_end(true);
 		
 		try {ResBase::get().init_ren_wait();}
 		catch (std::exception& e) {
@@ -349,7 +612,7 @@ public:
 		});
 		
 		// remove all references to particle generators (invalidated)
-		part_del.clear();
+		part_new.clear();
 		for (auto& cmd : cmds_queue)
 		{
 			if (auto c = std::get_if<PresCmdParticles>(&cmd))
@@ -375,6 +638,42 @@ public:
 		auto& cam = RenderControl::get().get_world_camera();
 		return Rectfp::from_center( cam.get_state().pos, (cam.coord_size() /2) + vport_offset );
 	}
+	int grid_cell_index(vec2fp p)
+	{
+		vec2i c = (p / grid_cell).int_floor();
+		c.x = std::clamp(c.x, 0, grid_size.x - 1);
+		c.y = std::clamp(c.y, 0, grid_size.y - 1);
+		return c.y * grid_size.x + c.x;
+	}
+	/// Returns cells overlapping area
+	Rect grid_cells(const Rectfp& area)
+	{
+		int a = grid_cell_index(area.lower());
+		int b = grid_cell_index(area.upper());
+		return Rect::bounds({a % grid_size.x, a / grid_size.x}, {b % grid_size.x + 1, b / grid_size.x + 1});
+	}
+	void grid_move(uint32_t i, vec2fp pos)
+	{
+		auto& ei = regs[i];
+		int cell = grid_cell_index(pos);
+		if (cell == ei.cell) return;
+		
+		grid_remove(i);
+		ei.cell = cell;
+		ei.cell_slot = grid[cell].size();
+		grid[cell].push_back(i);
+	}
+	void grid_remove(uint32_t i)
+	{
+		auto& ei = regs[i];
+		if (ei.cell == -1) return;
+		
+		auto& gc = grid[ei.cell];
+		regs[gc.back()].cell_slot = ei.cell_slot;
+		gc[ei.cell_slot] = gc.back();
+		gc.pop_back();
+		ei.cell = -1;
+	}
 	
 	
 	
@@ -400,14 +699,12 @@ public:
 	void add_effect(std::unique_ptr<GameRenderEffect> c) override
 	{
 		if (loadgame_hack) return;
-//		reserve_more_block(ef_fs, 128);
-		ef_fs.emplace_new(std::move(c));
+		effs_new.emplace_back(std::move(c));
 	}
 	void add_float_text(FloatText c) override
 	{
 		if (loadgame_hack) return;
-		reserve_more_block(f_texts, 128);
-		f_texts.emplace_back(std::move(c));
+		texts_new.emplace_back(std::move(c));
 	}
 	
 	
@@ -426,18 +723,29 @@ public:
 		auto p = getreg(c.ent.index, true);
 		p->pos = &c;
 		p->subs.clear();
+		p->ren_id = ++ren_id_last;
+		++regs_count;
+		
+		uint32_t i = c.ent.index.to_int();
+		grid_move(i, c.pos.pos);
+		if (!p->in_vis) {
+			p->in_vis = true;
+			vis_list.push_back(i); // visible until first sync
+		}
 	}
 	void on_rem(EC_RenderPos& pc) override
 	{
 		getreg(pc.ent.index)->pos = {};
-		Transform pos = pc.newest();
+		grid_remove(pc.ent.index.to_int());
+		--regs_count;
+		Transform pos = pc.get_cur();
 		
 		for (auto& cmd : cmds_queue)
 		{
 			if (auto c = std::get_if<PresCmdParticles>(&cmd);
 			    c && c->eid == pc.ent.index)
 			{
-				auto& pd = part_del.emplace_back();
+				auto& pd = part_new.emplace_back();
 				pd.gen = c->gen;
 				pd.pars = c->pars;
 				pd.pars.tr = pos.get_combined(c->pars.tr);
@@ -447,8 +755,10 @@ public:
 	}
 	void on_add(EC_RenderComp& c) override
 	{
-		if (auto p = getreg(c.ent.index))
+		if (auto p = getreg(c.ent.index)) {
 			p->subs.push_back(&c);
+			c.ren_id = ++ren_id_last;
+		}
 	}
 	void on_rem(EC_RenderComp& c) override
 	{
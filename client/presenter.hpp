@@ -1,6 +1,7 @@
 #ifndef GAME_PRESENTER_HPP
 #define GAME_PRESENTER_HPP
 
+#include <optional>
 #include <variant>
 #include "game/entity.hpp"
 #include "render/ren_particles.hpp"
@@ -47,7 +48,8 @@ private:
 
 
 
-// Intended to run in separate thread with external sync
+/// sync() and all functions adding objects are called from logic thread (or with core locked). 
+/// render() receives state copied by last sync() and doesn't require lock
 class GamePresenter
 {
 public:
@@ -60,6 +62,9 @@ public:
 	bool playback_hack = false; ///< Disables interpolation
 	bool loadgame_hack = false; ///< Ignore all effect and particle commands
 	
+	TimeSpan dbg_sync_time; ///< Duration of last sync() call
+	TimeSpan dbg_render_time; ///< Duration of last render() call
+	
 	static GamePresenter* init(const InitParams& pars); ///< Creates singleton
 	static GamePresenter* get(); ///< Returns singleton
 	virtual ~GamePresenter();
@@ -69,7 +74,13 @@ public:
 	
 	virtual void render(TimeSpan now, TimeSpan passed) = 0; ///< Renders everything (must be called from render thread)
 	virtual TimeSpan get_passed() = 0; ///< Returns last passed time (for components)
-	virtual Rectfp get_vport() = 0; ///< Returns world frustum rect
+	virtual Rectfp get_vport() = 0; ///< Returns world frustum rect set by last publish_vport()
+	
+	/// Updates frustum rect from camera, for next sync. Called by render() (render thread)
+	virtual void publish_vport() = 0;
+	
+	/// Returns interpolated position, if entity was rendered (render thread)
+	virtual std::optional<vec2fp> get_render_pos(EntityIndex eid) = 0;
 	
 	void effect(PGG_Pointer ppg, const ParticleBatchPars& pars);
 	
@@ -38,9 +38,13 @@ public:
 	};
 	struct InitResult {
 		std::array<AAL_Model, MODEL_TOTAL_COUNT_INTERNAL> ms;
-		std::unique_ptr<Texture> tex;
+		std::array<std::optional<Rectfp>, MODEL_TOTAL_COUNT_INTERNAL> img_tc; ///< Atlas texture coordinates
+		ImageInfo atlas;
+		std::unique_ptr<Texture> tex; ///< Set by 'tex_upload'
+		std::future<void> tex_upload;
 	};
-	std::optional<InitResult> future_init;
+	std::unique_ptr<InitResult> future_init; ///< Heap-allocated, referenced by posted upload
+	
 	
 	
 	
@@ -79,7 +83,7 @@ public:
 	void init_ren_wait();
 	void init_ren();
 	
-	InitResult init_func();
+	std::unique_ptr<InitResult> init_func();
 };
 
 static ResBase_Impl* resbase_ptr;
@@ -103,10 +107,25 @@ void ResBase_Impl::init_ren_wait()
 {
 	if (!future_init) future_init = init_func();
 	auto mlns = std::move(future_init->ms);
-	RenderControl::get().exec_task([&] {
-		tex = std::move(future_init->tex);
+	
+	// queued after atlas upload, so both are finished when it runs
+	auto swap_upload = RenderControl::get().post_task([this] {
 		tex_explowave.reset(Texture::load(HARDPATH_EXPLOSION_IMG));
+		tex = std::move(future_init->tex);
+		for (size_t i=0; i < MODEL_TOTAL_COUNT_INTERNAL; ++i) {
+			if (auto& tc = future_init->img_tc[i])
+				md_img[i] = {tex.get(), *tc};
+		}
 	});
+	
+	// single wait for both; swap is queued last, so atlas upload is finished after it
+	try {
+		swap_upload.get();
+		if (future_init->tex_upload.valid()) future_init->tex_upload.get();
+	}
+	catch (std::future_error&) {
+		throw std::runtime_error("ResBase::init_ren_wait() interrupted");
+	}
 	future_init.reset();
 	
 	const float kw = 1, ka = 3;
@@ -119,11 +138,12 @@ void ResBase_Impl::init_ren_wait()
 			throw std::logic_error(std::to_string(i) + " - index mismatch (internal error)");
 	}
 }
-ResBase_Impl::InitResult ResBase_Impl::init_func()
+std::unique_ptr<ResBase_Impl::InitResult> ResBase_Impl::init_func()
 {
-	InitResult initres;
+	auto initres_ptr = std::make_unique<InitResult>();
+	auto& initres = *initres_ptr;
 	
-	struct Explosion : ParticleGroupGenerator
+	struct Explosion : ParticleGroupStd<Explosion>
 	{
 		size_t n_base; // base count
 		FColor clr0, clr1; // color range
@@ -168,7 +188,7 @@ ResBase_Impl::InitResult ResBase_Impl::init_func()
 			p.acc = decel_f * -p.vel / (p.lt + p.ft);
 		}
 	};
-	struct WpnExplosion : ParticleGroupGenerator
+	struct WpnExplosion : ParticleGroupStd<WpnExplosion>
 	{
 		FColor clr   = FColor(0.2, 0.2, 1);
 		FColor clr_n = FColor(0.1, 0.1, 0.4);
@@ -231,7 +251,7 @@ ResBase_Impl::InitResult ResBase_Impl::init_func()
 			t += dt;
 		}
 	};
-	struct Death : ParticleGroupGenerator
+	struct Death : ParticleGroupStd<Death>
 	{
 		struct Ln {
 			vec2fp a, b;
@@ -286,7 +306,7 @@ ResBase_Impl::InitResult ResBase_Impl::init_func()
 			p.ft = rnd_stat().range(1, 2.5); //3,5
 		}
 	};
-	struct Aura : ParticleGroupGenerator
+	struct Aura : ParticleGroupStd<Aura>
 	{
 		struct Ln {
 			vec2fp a, b, av, bv;
@@ -364,7 +384,7 @@ ResBase_Impl::InitResult ResBase_Impl::init_func()
 			p.decel_to_zero();
 		}
 	};
-	struct WpnCharge : ParticleGroupGenerator
+	struct WpnCharge : ParticleGroupStd<WpnCharge>
 	{
 		ParticleBatchPars bp;
 		
@@ -388,7 +408,7 @@ ResBase_Impl::InitResult ResBase_Impl::init_func()
 			p.acc = -p.vel / (p.lt + p.ft + 3);
 		}
 	};
-	struct FireSpread : ParticleGroupGenerator
+	struct FireSpread : ParticleGroupStd<FireSpread>
 	{
 		Transform tr;
 		float dist, angle, anglim;
@@ -424,7 +444,7 @@ ResBase_Impl::InitResult ResBase_Impl::init_func()
 			p.decel_to_zero();
 		}
 	};
-	struct CircAura : ParticleGroupGenerator
+	struct CircAura : ParticleGroupStd<CircAura>
 	{
 		ParticleBatchPars bp;
 		size_t i, num;
@@ -462,7 +482,7 @@ ResBase_Impl::InitResult ResBase_Impl::init_func()
 			p.size = rnd_stat().range(0.1, 0.2);
 		}
 	};
-	struct ExploFrag : ParticleGroupGenerator
+	struct ExploFrag : ParticleGroupStd<ExploFrag>
 	{
 		vec2fp ctr;
 		float pwr;
@@ -495,7 +515,7 @@ ResBase_Impl::InitResult ResBase_Impl::init_func()
 			p.apply_gravity(2);
 		}
 	};
-	struct FrostAura : ParticleGroupGenerator
+	struct FrostAura : ParticleGroupStd<FrostAura>
 	{
 		vec2fp ctr;
 		float pwr, rad, t, td;
@@ -964,8 +984,7 @@ ResBase_Impl::InitResult ResBase_Impl::init_func()
 	
 	// generate images
 	
-	initres.tex.reset(
-	[&]()-> Texture* {
+	[&] {
 		TimeSpan time0 = TimeSpan::since_start();
 	        
 		struct Info
@@ -1016,11 +1035,11 @@ ResBase_Impl::InitResult ResBase_Impl::init_func()
 		}
 	    
 		auto as = abd.build();
-		ImageInfo res;
+		ImageInfo& res = initres.atlas;
 		
 		if (as.empty()) {
 			VLOGE("Resbase:: no images");
-			return {};
+			return;
 		}
 		
 		res.reset({ as[0].info.w, as[0].info.h });
@@ -1029,21 +1048,20 @@ ResBase_Impl::InitResult ResBase_Impl::init_func()
 		VLOGI("Resbase:: generated images in {:.3f} seconds, {}x{} atlas",
 		      (TimeSpan::since_start() - time0).seconds(), res.get_size().x, res.get_size().y);
 		
-		Texture* tx;
-		RenderControl::get().exec_task([&]{
-			tx = Texture::create_from(res);
+		// not waited here - result is needed only in init_ren_wait()
+		initres.tex_upload = RenderControl::get().post_task([r = &initres] {
+			r->tex.reset( Texture::create_from(r->atlas) );
+			r->atlas = {};
 		});
 		
 		for (auto& a : as[0].info.sprs)
 		{
 			auto& inf = md_is[a.id];
-			auto& t = md_img[inf.type];
-			t.tex = tx;
-			t.tc.a = vec2fp(a.x, a.y) / vec2fp(res.get_size());
-			t.tc.b = vec2fp(a.w, a.h) / vec2fp(res.get_size()) + t.tc.a;
+			auto& tc = initres.img_tc[inf.type].emplace();
+			tc.a = vec2fp(a.x, a.y) / vec2fp(res.get_size());
+			tc.b = vec2fp(a.w, a.h) / vec2fp(res.get_size()) + tc.a;
 		}
-		return tx;
-	}());
+	}();
 
-	return initres;
+	return initres_ptr;
 }
@@ -0,0 +1,106 @@
+#include <algorithm>
+#include "client/presenter.hpp"
+#include "render/control.hpp"
+#include "render/pp_graph.hpp"
+#include "render/ren_text.hpp"
+#include "vaslib/vas_file.hpp"
+#include "vaslib/vas_log.hpp"
+#include "bench.hpp"
+
+static std::unique_ptr<RenderBench> rbench;
+
+void RenderBench::init(std::string csv_filename)
+{
+	rbench.reset(new RenderBench);
+	rbench->csv_filename = std::move(csv_filename);
+}
+RenderBench* RenderBench::get()
+{
+	return rbench.get();
+}
+void RenderBench::frame_end(TimeSpan total)
+{
+	auto text_time = TextRenderInfo::dbg_build_time;
+	TextRenderInfo::dbg_build_time = {};
+	
+	if (!record_frame) return;
+	record_frame = false;
+	
+	auto ms = [](TimeSpan t) {return t.micro() / 1000.f;};
+	auto& pp = PP_Graph::get();
+	auto& f = frames.emplace_back();
+	
+	if (auto p = GamePresenter::get()) f[S_PRESENTER] = ms(p->dbg_sync_time + p->dbg_render_time);
+	else f[S_PRESENTER] = 0;
+	
+	f[S_AAL] = pp.get_last_cpu("grid") + pp.get_last_cpu("aal");
+	f[S_PARTICLES] = pp.get_last_cpu("parts");
+	f[S_TEXT] = ms(text_time);
+	f[S_POSTPROC] = pp.get_last_cpu() - f[S_AAL] - f[S_PARTICLES];
+	f[S_SWAP] = ms(RenderControl::get().get_swap_time());
+	f[S_FRAME] = ms(total);
+}
+void RenderBench::finish()
+{
+	std::string s;
+	for (int i=0; i < S_TOTAL_COUNT_INTERNAL; ++i) {
+		if (i) s += ',';
+		s += get_name(static_cast<Section>(i));
+	}
+	s += '\n';
+	
+	for (auto& f : frames) {
+		for (int i=0; i < S_TOTAL_COUNT_INTERNAL; ++i) {
+			if (i) s += ',';
+			s += FMT_FORMAT("{:.3f}", f[i]);
+		}
+		s += '\n';
+	}
+	
+	if (!writefile(csv_filename.c_str(), s.data(), s.size())) VLOGE("RenderBench::finish() failed - \"{}\"", csv_filename);
+	else VLOGI("RenderBench::finish() written to \"{}\"", csv_filename);
+	
+	// summary
+	
+	s = FMT_FORMAT("Benchmark: {} frames, milliseconds\n", frames.size());
+	s += FMT_FORMAT("  {:10} {:>8} {:>8} {:>8} {:>8}\n", "", "mean", "median", "95%", "max");
+	
+	std::vector<float> vs;
+	vs.reserve(frames.size());
+	
+	for (int i=0; i < S_TOTAL_COUNT_INTERNAL && !frames.empty(); ++i)
+	{
+		vs.clear();
+		double sum = 0;
+		for (auto& f : frames) {
+			vs.push_back(f[i]);
+			sum += f[i];
+		}
+		std::sort(vs.begin(), vs.end());
+		
+		s += FMT_FORMAT("  {:10} {:8.3f} {:8.3f} {:8.3f} {:8.3f}\n", get_name(static_cast<Section>(i)),
+		                sum / vs.size(), vs[vs.size() / 2], vs[vs.size() * 95 / 100], vs.back());
+	}
+	
+	// compared by scripts/check_ai_threads.sh
+	if (checksum) s += FMT_FORMAT("World checksum: {:08x}\n", *checksum);
+	
+	VLOGI("{}", s);
+	printf("%s", s.c_str());
+}
+const char* RenderBench::get_name(Section s)
+{
+	switch (s)
+	{
+	case S_PRESENTER: return "presenter";
+	case S_AAL:       return "aal";
+	case S_PARTICLES: return "particles";
+	case S_TEXT:      return "text";
+	case S_POSTPROC:  return "postproc";
+	case S_SWAP:      return "swap";
+	case S_FRAME:     return "frame";
+	
+	case S_TOTAL_COUNT_INTERNAL: break;
+	}
+	return "INVALID";
+}
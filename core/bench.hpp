@@ -0,0 +1,49 @@
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+#include <array>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include "vaslib/vas_time.hpp"
+
+/// Collects per-frame CPU times of rendering parts for headless benchmark (--bench)
+class RenderBench
+{
+public:
+	enum Section
+	{
+		S_PRESENTER, ///< GamePresenter sync (logic thread) and render
+		S_AAL,       ///< RenAAL - level grid and objects
+		S_PARTICLES,
+		S_TEXT,      ///< Text layout
+		S_POSTPROC,  ///< All other postprocessing graph nodes
+		S_SWAP,      ///< Buffer swap and waiting for GPU
+		S_FRAME,     ///< Whole frame, including simulation step
+		
+		S_TOTAL_COUNT_INTERNAL ///< Do not use
+	};
+	
+	bool record_frame = false; ///< Set by game when it stepped world for current frame
+	bool failed = false; ///< Set by game if it couldn't be run; program exits with error
+	std::optional<uint32_t> checksum; ///< World checksum set by game when replay ends
+	
+	static void init(std::string csv_filename); ///< Enables benchmark
+	static RenderBench* get(); ///< Returns null if benchmark is not enabled
+	
+	/// Must be called after RenderControl::render(). 
+	/// Records times of finished frame if record_frame is set and resets it
+	void frame_end(TimeSpan total);
+	
+	/// Writes CSV with all frames and prints summary
+	void finish();
+	
+private:
+	std::string csv_filename;
+	std::vector<std::array<float, S_TOTAL_COUNT_INTERNAL>> frames; // milliseconds
+	
+	static const char* get_name(Section s);
+};
+
+#endif // BENCH_HPP
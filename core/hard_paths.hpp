@@ -22,6 +22,10 @@
 #define HARDPATH_EXPLOSION_IMG		HARDPATH_DATA_PREFIX"explosion_wave.png"
 #define HARDPATH_CROSSHAIR_IMG		HARDPATH_DATA_PREFIX"crosshair.png"
 #define HARDPATH_SMOKE_PROCIMG		HARDPATH_USR_PREFIX"procedural_smoke.png"
+#define HARDPATH_AI_STATS_CSV		HARDPATH_USR_PREFIX"ai_stats.csv"
+#define HARDPATH_BENCH_CSV			HARDPATH_USR_PREFIX"bench.csv"
+#define HARDPATH_FONT_CACHE			HARDPATH_USR_PREFIX"font_{:08x}.sdfcache"
+#define HARDPATH_SHADER_CACHE		HARDPATH_USR_PREFIX"shader_cache/"
 
 #define HARDPATH_TUTORIAL_LVL		HARDPATH_DATA_PREFIX"tutorial_lvl.png"
 #define HARDPATH_SURVIVAL_LVL		HARDPATH_DATA_PREFIX"survival_lvl.png"
@@ -2,8 +2,10 @@
 #include <SDL2/SDL.h>
 #include "client/resbase.hpp"
 #include "client/sounds.hpp"
+#include "core/bench.hpp"
 #include "core/hard_paths.hpp"
 #include "core/vig.hpp"
+#include "game/game_core.hpp"
 #include "render/control.hpp"
 #include "render/gl_utils.hpp" // debug stats
 #include "render/ren_imm.hpp"
@@ -47,7 +49,8 @@ static void set_wnd_pars()
 		SDL_FreeSurface( icon );
 	}
 	
-	SDL_ShowWindow(wnd);
+	if (!RenderControl::opt_headless)
+		SDL_ShowWindow(wnd);
 }
 
 
@@ -147,6 +150,7 @@ Mode options (--game):
   --superman     enable enhanced godmode for player
   --dbg-ai-rect  enable smaller AI online rects (for performance)
   --save-terr    save generated terrain data
+  --ai-stats <FILE>  write AI cost stats as CSV on exit
 
   --no-demo-record     disables default demo record (if no option specified)
   --demo-record        record replay to "user/replay_DATETIME.ratdemo"
@@ -156,6 +160,10 @@ Mode options (--game):
   --demo-write <FILE>  record replay to specified file (adds extension)
   --demo-play  <FILE>  playback replay from file
   --demo-last          same as "--demo-play user/last.ratdemo"
+  --bench      <FILE>  render replay headless (offscreen EGL, no window) at fixed
+                       steps as fast as possible; writes per-frame CPU times
+                       to "user/bench.csv" and prints summary and world checksum
+                       (see scripts/check_ai_threads.sh)
   --loadgame   <FILE>  loads replay as savegame
   --loadlast           same as "--loadgame user/savegame.ratdemo"
   --savegame           record replay to savegame file + rename it after game is finished
@@ -225,6 +233,12 @@ Mode options (--game):
 	
 	
 	
+	if (RenderBench::get()) {
+		RenderControl::opt_headless = true;
+		nosleep = true;
+		no_sound = true;
+	}
+	
 	set_signals();
 	
 	{	std::error_code ec;
@@ -296,9 +310,14 @@ Mode options (--game):
 	{
 		vig_label_a(
 			"Buffer : max {:4} KB, current {:4} KB\n"
-			"Texture : {:4} KB\n",
+			"Texture : {:4} KB\n"
+			"Stream upload : {:4} KB, stalls: {}\n"
+			"Offscreen scale : {:.2f} ({}x{})\n",
 			GLA_Buffer::dbg_size_max >> 10, GLA_Buffer::dbg_size_now >> 10,
-			Texture::dbg_total_size >> 10);
+			Texture::dbg_total_size >> 10,
+			GLA_StreamBuffer::dbg_upload_bytes >> 10, GLA_StreamBuffer::dbg_stalls,
+			RenderControl::get().get_offscreen_scale(),
+			RenderControl::get().get_offscreen_size().x, RenderControl::get().get_offscreen_size().y);
 		
 		auto fs_val = RenderControl::get().get_fscreen();
 		if (vig_button("Fullscreen on", 0, fs_val == RenderControl::FULLSCREEN_ENABLED))
@@ -331,7 +350,9 @@ Mode options (--game):
 	}
 	log_write_str(LogLevel::Critical, "=== Renderer initialization finished ===");
 	
-	if (int set = AppSettings::get().set_vsync; set != -1)
+	if (RenderBench::get())
+		RenderControl::get().set_vsync(false);
+	else if (int set = AppSettings::get().set_vsync; set != -1)
 		RenderControl::get().set_vsync(set);
 	else VLOGI("set_vsync = ignored");
 	
@@ -392,7 +413,13 @@ Mode options (--game):
 		VLOGI("Target FPS (native refresh rate): {}", target_fps);
 	}
 	
+	if (RenderBench::get()) {
+		target_fps = TimeSpan::seconds(1) / GameCore::step_len;
+		VLOGI("Target FPS (benchmark - one step per frame): {}", target_fps);
+	}
+	
 	TimeSpan loop_length = TimeSpan::fps( target_fps );
+	RenderControl::get().frame_budget = loop_length;
 	bool loop_limit = !nosleep;//!RenderControl::get().has_vsync() || target_fps != vsync_fps;
 	VLOGD("Main loop limiter: {}", loop_limit);
 	
@@ -549,6 +576,9 @@ Mode options (--game):
 		}
 		
 		TimeSpan loop_total = TimeSpan::current() - loop_0;
+		RenderControl::get().frame_time = loop_total;
+		if (auto p = RenderBench::get()) p->frame_end(loop_total);
+		
 		if (loop_limit && loop_total < loop_length)
 		{
 			passed = loop_length;
@@ -578,6 +608,11 @@ Mode options (--game):
 	VLOGI("Total run time: {:.3f} seconds", TimeSpan::since_start().seconds());
 	VLOGI("Average render frame length: {} ms, {} samples", avg_total, avg_total_n);
 	VLOGI("Render frame length > sleep time: {} samples", overmax_count);
+	bool bench_failed = false;
+	if (auto p = RenderBench::get()) {
+		p->finish();
+		bench_failed = p->failed;
+	}
 	log_write_str(LogLevel::Critical, "main() normal exit");
 	
 	dbg_g.trigger();
@@ -592,5 +627,5 @@ Mode options (--game):
 	
 	VLOGI("main() cleanup finished");
 	log_terminate_h_reset();
-	return 0;
+	return bench_failed ? 1 : 0;
 }
@@ -4,6 +4,7 @@
 #include "client/plr_input.hpp"
 #include "client/replay.hpp"
 #include "client/sounds.hpp"
+#include "core/bench.hpp"
 #include "core/hard_paths.hpp"
 #include "core/settings.hpp"
 #include "core/vig.hpp"
@@ -11,6 +12,7 @@
 #include "game/game_mode.hpp"
 #include "game/level_gen.hpp"
 #include "game/player_mgr.hpp"
+#include "game_ai/ai_control.hpp"
 #include "game_ctr/game_control.hpp"
 #include "game_ctr/game_ui.hpp"
 #include "game_objects/spawners.hpp"
@@ -753,6 +755,7 @@ public:
 	bool is_superman_init = false;
 	bool debug_ai_rect_init = false;
 	bool save_terrain = false;
+	std::string ai_stats_csv; ///< Written on exit if set
 	
 	// init replay
 	
@@ -800,6 +803,10 @@ public:
 				VLOGE("Interrupted initialization failed: {}", e.what());
 			}
 		}
+		if (gctr && gctr->has_core() && !ai_stats_csv.empty()) {
+			auto lock = gctr->core_lock();
+			gctr->get_core().get_aic().stats.write_csv(ai_stats_csv.c_str());
+		}
 	}
 	bool parse_arg(ArgvParse& arg)
 	{
@@ -825,6 +832,7 @@ public:
 		else if (arg.is("--superman")) is_superman_init = true;
 		else if (arg.is("--dbg-ai-rect")) debug_ai_rect_init = true;
 		else if (arg.is("--save-terr")) save_terrain = true;
+		else if (arg.is("--ai-stats")) ai_stats_csv = arg.str();
 		
 		else if (arg.is("--no-demo-record")) {
 			replay_write_default = false;
@@ -847,6 +855,14 @@ public:
 			if (get_file_ext(s).empty()) s += ".ratdemo";
 			replay_init_read = ReplayInit_File{ std::move(s) };
 		}
+		else if (arg.is("--bench"))
+		{
+			auto s = arg.str();
+			if (get_file_ext(s).empty()) s += ".ratdemo";
+			replay_init_read = ReplayInit_File{ std::move(s) };
+			replay_write_default = false;
+			RenderBench::init(HARDPATH_BENCH_CSV);
+		}
 		else if (arg.is("--demo-last"))
 		{
 			replay_init_read = ReplayInit_File{ HARDPATH_USR_PREFIX"last.ratdemo" };
@@ -899,6 +915,8 @@ public:
 			if (no_ffwd)
 				gci.fastforward_time = {};
 			
+			gci.lockstep = !!RenderBench::get();
+			
 			if (use_seed) {
 				gci.rndg.set_seed(*use_seed);
 				VLOGI("Level seed (cmd): {}", *use_seed);
@@ -965,7 +983,10 @@ public:
 				}}
 			, replay_init_read);
 			
-			if (replay_dat.incompat_version) {
+			if (replay_dat.incompat_version && RenderBench::get()) {
+				VLOGW("Replay was made using another version - {}", *replay_dat.incompat_version);
+			}
+			else if (replay_dat.incompat_version) {
 				vigWarnbox wb{"WARNING",
 					FMT_FORMAT("Saved game was made using another version\nplatform:\n\n{}\nversus current:\n{}\n\nLoad anyway?",
 				               *replay_dat.incompat_version, get_full_platform_version())};
@@ -1062,6 +1083,19 @@ public:
 			async_init.get()();
 		}
 		
+		if (auto bench = RenderBench::get())
+		{
+			auto state = gctr->get_state();
+			if (auto st = std::get_if<GameControl::CS_End>(&state)) {
+				if (st->is_exception || !gctr_inited) {
+					VLOGE("Benchmark: game failed - {}", st->err_msg);
+					bench->failed = true;
+				}
+				delete this;
+				return;
+			}
+		}
+		
 		if (!gctr_inited && std::holds_alternative<GameControl::CS_Run>(gctr->get_state()))
 		{
 		    gctr_inited = true;
@@ -1076,6 +1110,12 @@ public:
 			gui->on_enter();
 		}
 		
+		if (auto bench = RenderBench::get(); bench && gctr_inited)
+		{
+			gctr->step_lockstep();
+			bench->record_frame = true;
+		}
+		
 		try {
 			gui->render(frame_begin, passed);
 		}
@@ -66,6 +66,11 @@ LineCfg AppSettings::gen_cfg()
 	P_ENUM(set_vsync, int, {-1, "dont_set"}, {0, "force_off"}, {1, "on"})
 		.descr("vertical synchronization: dont_set, force_off, on");
 	
+	cs.emplace_back("dyn_res", true)
+	.vfloat(dyn_res_min, 1, 0.25)
+	.vfloat(dyn_res_max, 1, 0.25)
+		.descr("scale of offscreen buffers, min and max - adjusted to keep target FPS. Equal values disable it");
+	
 	P_BOOL(use_audio).descr("enable sound");
 	P_FLOAT(audio_volume).descr("master audio volume (linear)");
 	P_FLOAT(sfx_volume).descr("sound effects volume (linear)");
@@ -89,12 +94,21 @@ LineCfg AppSettings::gen_cfg()
 	P_INT(font_supersample, 8, 1)
 		.descr("font atlas upscale");
 	
+	P_BOOL(font_sdf)
+		.descr("use distance field font atlas - sharp at any scale, cached in user directory. Ignores font_supersample");
+	
+	P_BOOL(shader_cache)
+		.descr("store compiled shaders in user directory to speed up startup");
+	
 	P_FLOAT(cam_pp_shake_str)
 		.descr("camera shake effect strength");
 	
 	P_ENUM(interp_depth, int, {0, "0"}, {2, "2"}, {3, "3"})
 		.descr("interpolation depth (0, 2 or 3)");
 	
+	P_INT(ai_threads, 16)
+		.descr("worker threads for AI perception checks, 0 to run them on game thread");
+	
 	P_INT(cursor_info_flags, 1)
 		.descr("info shown on cursor - sum of: 1 weapon status, 2 shield status, 4 more status");
 	        
@@ -111,6 +125,8 @@ void AppSettings::init_default()
 	wnd_size = {1024, 600};
 	target_fps = 0;
 	set_vsync = 1;
+	dyn_res_min = 0.5;
+	dyn_res_max = 1;
 	fscreen = FS_Maximized;
 	
 	use_audio = true;
@@ -129,10 +145,13 @@ void AppSettings::init_default()
 	font_pt = 16;
 	font_dbg_pt = 16;
 	font_supersample = 2;
+	font_sdf = true;
 	
+	shader_cache = true;
 	cam_pp_shake_str = 0.007;
 	interp_depth = 3;
 	
+	ai_threads = 2;
 	cursor_info_flags = 1;
 	plr_status_blink = true;
 	plr_status_flare = true;
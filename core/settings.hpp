@@ -16,6 +16,7 @@ struct AppSettings
 	vec2i wnd_size;
 	int target_fps;
 	int set_vsync;
+	float dyn_res_min, dyn_res_max;
 	
 	enum FS_Type {FS_Windowed, FS_Maximized, FS_Borderless, FS_Fullscreen};
 	FS_Type fscreen;
@@ -38,12 +39,15 @@ struct AppSettings
 	float font_pt;
 	float font_dbg_pt;
 	int font_supersample;
+	bool font_sdf;
 	
 	// renderer effects etc
+	bool shader_cache;
 	float cam_pp_shake_str;
 	int interp_depth;
 	
 	// game
+	int ai_threads;
 	int cursor_info_flags;
 	bool plr_status_blink;
 	bool plr_status_flare;
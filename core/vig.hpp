@@ -85,6 +85,7 @@ enum class VigMenu
 	Default,
 	DebugRenderer,
 	DebugGame,
+	DebugAI,
 	
 	TOTAL_COUNT ///< Do not use
 };
@@ -31,6 +31,10 @@ public:
 	bool spawn_drop; ///< From destroyed enemies
 	bool spawn_hunters;
 	
+	/// Derived from initial state of get_random().
+	/// For seeding generators which must not change sequence of the main one
+	uint32_t seed = 0;
+	
 	static GameCore* create(InitParams pars); ///< Creates empty handler and inits all systems
 	virtual ~GameCore() = default; ///< Destroys all systems
 	
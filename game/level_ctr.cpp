@@ -1,3 +1,4 @@
+#include <queue>
 #include "utils/path_search.hpp"
 #include "vaslib/vas_log.hpp"
 #include "game_core.hpp"
@@ -8,7 +9,8 @@
 
 PathRequest::PathRequest(GameCore& core, vec2fp from, vec2fp to,
                          std::optional<float> max_length,
-                         std::optional<Evade> evade)
+                         std::optional<Evade> evade,
+                         PathSearch* aps)
 {
 	auto& lc = core.get_lc();
 	vec2i pa = lc.to_nonwall_coord(from);
@@ -32,7 +34,7 @@ PathRequest::PathRequest(GameCore& core, vec2fp from, vec2fp to,
 		args.evade_cost = evade->added_cost;
 	}
 	
-	auto r = lc.get_aps().find_path(args);
+	auto r = (aps ? *aps : lc.get_aps()).find_path(args);
 	res = Result{};
 	
 	if (r.ps.empty())
@@ -189,6 +191,43 @@ LevelControl::LevelControl(const LevelTerrain& lt)
 		if (c0.room_nearest == size_t_inval)
 			c0.room_nearest = 0;
 	}
+	
+	calc_radio_order();
+}
+void LevelControl::calc_radio_order()
+{
+	using Node = std::pair<int, size_t>; // distance, room
+	std::priority_queue<Node, std::vector<Node>, std::greater<Node>> open;
+	std::vector<int> dist;
+	
+	for (size_t r0 = 0; r0 < rooms.size(); ++r0)
+	{
+		dist.assign( rooms.size(), std::numeric_limits<int>::max() );
+		dist[r0] = 0;
+		open.push({ 0, r0 });
+		
+		auto& order = rooms[r0].radio_order;
+		order.clear();
+		
+		while (!open.empty())
+		{
+			auto [d, ri] = open.top();
+			open.pop();
+			if (d != dist[ri]) continue; // already visited with lower distance
+			
+			order.emplace_back(ri, d);
+			
+			int cost = d + rooms[ri].ai_radio_cost;
+			for (auto& ni : rooms[ri].neis)
+			{
+				if (cost < dist[ni])
+				{
+					dist[ni] = cost;
+					open.push({ cost, ni });
+				}
+			}
+		}
+	}
 }
 LevelControl::~LevelControl() = default;
 void LevelControl::fin_init(const LevelTerrain& lt)
@@ -203,6 +242,7 @@ LevelControl::Cell& LevelControl::mut_cell(vec2i pos)
 {
 	if (!is_valid(pos)) throw std::runtime_error("LevelControl::mut_cell() null");
 	aps_req_update = true;
+	++cells_version;
 	return cells[pos.y * size.x + pos.x];
 }
 const LevelControl::Cell* LevelControl::cell(vec2i pos) const noexcept
@@ -290,6 +330,7 @@ void LevelControl::update_aps(bool forced)
 		aps_ps[i] = cells[i].is_wall ? 0 : 1;
 	
 	aps->update(size, std::move(aps_ps));
+	++aps_version;
 }
 void LevelControl::set_wall(vec2i pos, bool is_wall)
 {
@@ -29,9 +29,15 @@ struct PathRequest
 	PathRequest() = default;
 	PathRequest(const PathRequest&) = delete;
 	
+	/// Searches synchronously using 'aps' if set, otherwise using level one. 
+	/// Doesn't change anything except 'aps', so may be called from AI worker threads
 	PathRequest(GameCore& core, vec2fp from, vec2fp to,
 	            std::optional<float> max_length = {},
-	            std::optional<Evade> evade = {});
+	            std::optional<Evade> evade = {},
+	            PathSearch* aps = nullptr);
+	
+	/// Wraps result obtained earlier
+	explicit PathRequest(Result r): res(std::move(r)) {}
 	
 	/// Returns true if result is available or waiting
 	bool is_ok() const {return !!res;}
@@ -61,9 +67,12 @@ struct LevelCtrRoom
 	std::vector<size_t> neis; ///< rooms
 	
 	int ai_radio_cost = 1;
-	mutable int tmp; ///< for algorithms
 	mutable int ai_patrolling = 0;
 	
+	/// Reachable rooms (including this one) with distances, sorted by ascending distance. 
+	/// Distance is sum of 'ai_radio_cost' of all rooms on the path, excluding the last one
+	std::vector<std::pair<size_t, int>> radio_order;
+	
 	Rectfp fp_area() const {
 		return area.to_fp(GameConst::cell_size);
 	}
@@ -77,8 +86,6 @@ public:
 		vec2i pos; ///< self
 		bool is_wall;
 		
-		int tmp; ///< for algorithms
-		
 		std::optional<size_t> room_i;
 		size_t room_nearest; ///< Always valid, even for walls
 	};
@@ -104,6 +111,7 @@ public:
 	bool is_valid(vec2i pos) const {return is_in_bounds(pos, size);}
 	
 	Cell& mut_cell(vec2i pos); ///< Updates pathfinding at the end of the step
+	uint32_t get_cells_version() const {return cells_version;} ///< Changed each time mut_cell() is called
 	const Cell* cell(vec2i pos) const noexcept;
 	const Cell& cref(vec2i pos) const;
 	
@@ -114,6 +122,7 @@ public:
 	vec2fp get_closest(SpawnType type, vec2fp from) const;
 	const std::vector<Spawn>& get_spawns() const {return spps;}
 	PathSearch& get_aps() {return *aps;}
+	uint32_t get_aps_version() const {return aps_version;} ///< Changed each time path search is updated
 	
 	static vec2i to_cell_coord(vec2fp p) {return (p / GameConst::cell_size).int_floor();}
 	static vec2fp to_center_coord(vec2i p) {return vec2fp(p) * GameConst::cell_size + vec2fp::one(GameConst::cell_size * 0.5);}
@@ -127,10 +136,6 @@ public:
 	void update_aps(bool forced = true); ///< Updates wall states for path search
 	void set_wall(vec2i pos, bool is_wall); ///< Sets wall state and updates aps. Coord-safe
 	
-	void rooms_reset_tmp(int value) {
-		for (auto& r : rooms) r.tmp = value;
-	}
-	
 protected:
 	vec2i size;
 	std::vector<LevelCtrRoom> rooms;
@@ -138,8 +143,11 @@ protected:
 	std::vector<Spawn> spps;
 	std::unique_ptr<PathSearch> aps;
 	bool aps_req_update = false;
+	uint32_t aps_version = 0;
+	uint32_t cells_version = 0;
 	
 	LevelControl(const LevelTerrain& lt);
+	void calc_radio_order();
 };
 
 #endif // LEVEL_CTR_HPP
@@ -1,6 +1,7 @@
 #ifndef PHYSICS_HPP
 #define PHYSICS_HPP
 
+#include <atomic>
 #include <vector>
 #include <box2d/box2d.h>
 #include "utils/ev_signal.hpp"
@@ -233,7 +234,7 @@ public:
 	b2World world;
 	
 	// debug info
-	size_t raycast_count = 0;
+	std::atomic<size_t> raycast_count = 0; ///< Raycasts may be done from AI worker threads
 	size_t aabb_query_count = 0;
 	
 	
@@ -1,6 +1,7 @@
 #include "game/game_core.hpp"
 #include "game/player_mgr.hpp"
 #include "utils/noise.hpp"
+#include "vaslib/vas_log.hpp"
 #include "ai_algo.hpp"
 #include "ai_drone.hpp"
 
@@ -9,122 +10,94 @@
 
 
 
-void room_radio_flood(GameCore& core, vec2i pos, int max_depth, bool random_dirs, bool always_visit_adjacent,
+void room_radio_flood(GameCore& core, vec2i pos, int max_depth, bool random_dirs, bool /*always_visit_adjacent*/,
                       callable_ref<bool(const LevelCtrRoom&, int)> f)
 {
-	if (!max_depth) return;
-	always_visit_adjacent = false; // hack
-	
+	AI_Stats::Scope st_scope(core.get_aic().stats, AI_Stats::C_OP_RADIO_FLOOD);
 	auto& lc = core.get_lc();
-	auto& rnd = core.get_random();
-	std::vector<const LevelCtrRoom*> open, next, closed;
-	std::vector<size_t> i_tmp;
-	
-	open.reserve(32);
-	next.reserve(32);
-	closed.reserve(64);
-	
-	int depth = 0;
-	lc.rooms_reset_tmp( std::numeric_limits<int>::max() );
+	auto& order = lc.ref_room(lc.cref(pos).room_nearest).radio_order;
+	std::vector<std::pair<size_t, int>> o_tmp;
 	
-	auto room0 = &lc.ref_room(lc.cref(pos).room_nearest);
-	room0->tmp = 0;
-	open.push_back(room0);
-	
-	while (!open.empty() && depth < max_depth)
+	for (size_t i = 0; i < order.size() && order[i].second < max_depth; )
 	{
-		for (auto& rm : open)
-		{
-			if (closed.end() == std::find( closed.begin(), closed.end(), rm ))
-			{
-				if (!f( *rm, depth )) return;
-				closed.push_back(rm);
-			}
-			if (depth == max_depth - 1) continue;
-			
-			int cost = rm->tmp + rm->ai_radio_cost;
-			if (cost >= max_depth && (!always_visit_adjacent || rm->tmp)) continue;
-			
-			auto foo = [&](auto& is)
-			{
-				for (auto& i : is)
-				{
-					auto nr = &lc.ref_room(i);
-					if (nr->tmp > cost)
-					{
-						nr->tmp = cost;
-						next.push_back(nr);
-					}
-				}
-			};
-			if (!random_dirs) foo(rm->neis);
-			else {
-				i_tmp = rm->neis;
-				rnd.shuffle(i_tmp);
-				foo(i_tmp);
-			}
+		// group with same distance
+		size_t n = i + 1;
+		while (n < order.size() && order[n].second == order[i].second) ++n;
+		
+		auto it = order.begin() + i;
+		if (random_dirs && n - i > 1) {
+			o_tmp.assign(it, order.begin() + n);
+			core.get_random().shuffle(o_tmp);
+			it = o_tmp.begin();
 		}
 		
-		open.swap(next);
-		next.clear();
-		++depth;
+		for (; i < n; ++i, ++it) {
+			if (!f( lc.ref_room(it->first), it->second ))
+				return;
+		}
 	}
 }
 void room_query(GameCore& core, const LevelCtrRoom& rm, callable_ref<bool(AI_Drone&)> f)
 {
 	auto ai_area = core.get_pmg().get_ai_rects().second;
+	if (!rm.fp_area().overlaps(ai_area)) return;
 	
-	Rectfp r = rm.fp_area();
-	if (!r.overlaps(ai_area)) return;
-	
-	core.get_phy().query_aabb(r, [&](auto& ent, auto& fix)
-	{
-		if (fix.IsSensor()) return true;
-		if (auto d = ent.get_ai_drone(); d && d->is_online) return f(*d);
-		return true;
-	});
+	auto& lc = core.get_lc();
+	core.get_aic().room_query(&rm - lc.get_rooms().data(), f);
 }
 void area_query(GameCore& core, vec2fp ctr, float radius, callable_ref<bool(AI_Drone&)> f)
 {
-	core.get_phy().query_circle_all(conv(ctr), radius, [&](auto& ent, auto&){
-		return f(*ent.get_ai_drone());
-	},
-	[&](auto& ent, auto& fix)
-	{
-		if (fix.IsSensor()) return false;
-		if (auto d = ent.get_ai_drone(); d && d->is_online) return true;
-		return false;
-	});
+	core.get_aic().area_query(ctr, radius, f);
 }
 
-std::vector<std::vector<vec2fp>> calc_search_rings(GameCore& core, vec2fp ctr_pos, vec2fp fp_real_target, bool& real_inside)
+bool AI_SearchRings::is_inside(vec2fp real_target) const
+{
+	auto& ring_dist = AI_Const::search_ring_dist;
+	
+	vec2i p = LevelControl::to_cell_coord(real_target);
+	if (!area.contains_le(p)) return false;
+	
+	p -= area.lower();
+	int step = steps[p.y * area.size().x + p.x];
+	if (step <= ring_dist.front()) return false;
+	
+	for (auto& d : ring_dist) {
+		if (step == d)
+			return false;
+	}
+	return true;
+}
+std::shared_ptr<AI_SearchRings> calc_search_rings(GameCore& core, vec2i origin)
 {
 	const vec2i dirs[4] = {{1, 0}, {0, 1}, {-1, 0}, {0, -1}};
 	auto& ring_dist = AI_Const::search_ring_dist;
 	auto& lc = core.get_lc();
 	
-	Rect grid_area = Rect::from_center_le( lc.to_cell_coord(ctr_pos), vec2i::one(ring_dist.back() + 1) );
+	auto res = std::make_shared<AI_SearchRings>();
+	res->origin = origin;
+	res->cells_version = lc.get_cells_version();
+	
+	Rect& grid_area = res->area;
+	grid_area = Rect::from_center_le( origin, vec2i::one(ring_dist.back() + 1) );
 	grid_area = calc_intersection(grid_area, Rect::off_size({}, lc.get_size()));
 	
-	std::vector<uint8_t> cs;
+	std::vector<uint8_t> cs; // visited
 	cs.resize( grid_area.size().area() );
+	res->steps.resize( grid_area.size().area() );
 	
 	vec2i off = grid_area.lower();
-	auto getc = [&](vec2i p) -> auto& {
+	auto getc = [&](vec2i p) -> size_t {
 		p -= off;
-		return cs[p.y * grid_area.size().x + p.x];
+		return p.y * grid_area.size().x + p.x;
 	};
 	
 	std::vector<vec2i> free_nodes;
-	free_nodes.emplace_back( lc.to_cell_coord(ctr_pos) );
-	getc(free_nodes.back()) = 1;
+	free_nodes.emplace_back( origin );
+	cs[getc(free_nodes.back())] = 1;
 	
-	std::vector<std::vector<vec2fp>> rings;
+	auto& rings = res->rings;
 	rings.reserve( ring_dist.size() );
 	
-	vec2i real_target = lc.to_cell_coord(fp_real_target);
-	real_inside = false;
-	
 	for (int step = 1; step <= ring_dist.back() && !free_nodes.empty(); ++step)
 	{
 		auto nodes = std::move(free_nodes);
@@ -150,16 +123,15 @@ std::vector<std::vector<vec2fp>> calc_search_rings(GameCore& core, vec2fp ctr_po
 				vec2i p = n + d;
 				if (!grid_area.contains_le(p)) continue;
 				
-				auto& c = getc(p);
-				if (!c) {
-					c = 1;
+				size_t i = getc(p);
+				if (!cs[i]) {
+					cs[i] = 1;
 					if (!lc.cref(p).is_wall)
 					{
 						if (add_ring)
 							rings.back().emplace_back(lc.to_center_coord(p));
-						else if (!real_inside && p == real_target && !rings.empty())
-							real_inside = true;
 						
+						res->steps[i] = step;
 						free_nodes.emplace_back(p);
 					}
 				}
@@ -168,7 +140,7 @@ std::vector<std::vector<vec2fp>> calc_search_rings(GameCore& core, vec2fp ctr_po
 	}
 	
 	if (!rings.empty() && rings.back().empty()) rings.pop_back();
-	return rings;
+	return res;
 }
 
 
@@ -200,79 +172,159 @@ public:
 		}
 	};
 	
-	struct Cell {
+	struct FieldCell {
 		vec2i pos;
 		uint8_t i0, i1; ///< Origin indices range, [i0, i1)
+	};
+	
+	/// Rays and cells visible from origin cell - depends only on level walls
+	struct Field {
+		vec2i origin; ///< Cell
+		float max_radius;
+		uint32_t cells_version; ///< See LevelControl::get_cells_version()
+		uint32_t last_used;
+		
+		size_t origs_size; ///< Number of original rays
+		float ray_offset; ///< Add this to world angle to obtain AoS angle
+		
+		std::vector<FieldCell> cells;
+		Rect area; ///< Bounds of index
+		std::vector<int> index; ///< Cells by position in area, -1 if not visible
+		
+		int find(vec2i pos) const {
+			if (!area.contains_le(pos)) return -1;
+			pos -= area.lower();
+			return index[pos.y * area.size().x + pos.x];
+		}
+	};
+	
+	struct Cell {
+		const FieldCell* fc;
 		bool occupied = false;
 		float dist; ///< Approximate, not squared
 		
-		LevelControl::Cell& lcell(GameCore& core) {return core.get_lc().mut_cell(pos);}
-		int n_rays() {return i1 - i0;}
-		int i_mid() {return (int(i0) + int(i1)) /2;}
+		vec2i pos() const {return fc->pos;}
+		int n_rays() const {return fc->i1 - fc->i0;}
+		int i_mid() const {return (int(fc->i0) + int(fc->i1)) /2;}
 	};
 	
 	GameCore& core;
 	
+	std::vector<Field> fields; ///< LRU cache
+	uint32_t fields_counter = 0;
+	const Field* field = nullptr; ///< Current
+	
 	size_t origs_size; ///< Number of original rays
 	std::vector<Ray> origs; ///< Rays from center
-	std::vector<Cell> cells;
+	std::vector<Cell> cells; ///< Same indices as in current field
 	
 	vec2fp origin_pos;
 	float ray_diff; ///< Distance between adjacent rays in radians
 	float ray_offset; ///< Add this to world angle to obtain AoS angle
 	
+	// debug info
+	TimeSpan dbg_time_begin;
+	TimeSpan dbg_time; ///< Last placement
+	size_t dbg_hits = 0, dbg_misses = 0; ///< Field cache
+	
 	
 	
 	Cell* find_cell(vec2i pos) {
-		for (auto& c : cells) {
-			if (c.pos == pos)
-				return &c;
-		}
-		return nullptr;
+		int i = field->find(pos);
+		return i < 0 ? nullptr : &cells[i];
 	}
 	void for_rays(Cell& c, callable_ref<void(Ray& ray)> f) {
-		for (size_t i = c.i0; i < c.i1; ++i) f(origs[i]);
+		for (size_t i = c.fc->i0; i < c.fc->i1; ++i) f(origs[i]);
 	}
 	bool for_rays(Cell& c, callable_ref<bool(Ray& ray)> f) {
-		for (size_t i = c.i0; i < c.i1; ++i) if (!f(origs[i])) return false;
+		for (size_t i = c.fc->i0; i < c.fc->i1; ++i) if (!f(origs[i])) return false;
 		return true;
 	}
 	
 	AI_AOS_Impl(GameCore& core): core(core) {}
 	void place_begin(vec2fp origin, float max_radius) override
 	{
-		// prepare
+		dbg_time_begin = TimeSpan::current();
 		
 		auto& lc = core.get_lc();
+		field = &get_field(lc.to_cell_coord(origin), max_radius);
 		
-		origs_size = std::min(255., 2 * M_PI * max_radius);
+		origs_size = field->origs_size;
 		ray_diff = 2 * M_PI / origs_size;
+		ray_offset = field->ray_offset;
 		origin_pos = origin;
 		
 		origs.clear();
 		origs.resize(origs_size);
 		
 		cells.clear();
-		cells.reserve( std::pow((max_radius / GameConst::cell_size + 1)*2, 2) );
+		cells.reserve(field->cells.size());
+		for (auto& fc : field->cells)
+		{
+			auto& c = cells.emplace_back();
+			c.fc = &fc;
+			c.dist = lc.to_center_coord(fc.pos).dist(origin_pos);
+		}
 		
 		drones_orig.clear();
+	}
+	const Field& get_field(vec2i origin, float max_radius)
+	{
+		const uint32_t version = core.get_lc().get_cells_version();
+		++fields_counter;
+		
+		for (auto& f : fields) {
+			if (f.origin == origin && f.max_radius == max_radius && f.cells_version == version) {
+				f.last_used = fields_counter;
+				++dbg_hits;
+				return f;
+			}
+		}
+		++dbg_misses;
+		
+		Field* f;
+		if (fields.size() < AI_Const::placement_field_cache) f = &fields.emplace_back();
+		else {
+			f = &*std::min_element(fields.begin(), fields.end(),
+			                       [](auto& a, auto& b) {return a.last_used < b.last_used;});
+		}
+		
+		f->origin = origin;
+		f->max_radius = max_radius;
+		f->cells_version = version;
+		f->last_used = fields_counter;
+		calc_field(*f);
+		return *f;
+	}
+	void calc_field(Field& f)
+	{
+		// prepare
+		
+		auto& lc = core.get_lc();
+		
+		f.origs_size = std::min(255., 2 * M_PI * f.max_radius);
+		const float ray_diff = 2 * M_PI / f.origs_size;
+		
+		auto& cells = f.cells;
+		cells.clear();
+		cells.reserve( std::pow((f.max_radius / GameConst::cell_size + 1)*2, 2) );
 		
 		//
 		
-		const vec2fp ray_origin = origin / GameConst::cell_size;
-		const vec2i grid_origin = lc.to_cell_coord(origin);
-		const float ray_maxdist = std::ceil( max_radius / GameConst::cell_size );
+		const vec2i grid_origin = f.origin;
+		const vec2fp ray_origin = vec2fp(grid_origin) + vec2fp::one(0.5); // cell center
+		const float ray_maxdist = std::ceil( f.max_radius / GameConst::cell_size );
 		
-		calc_intersection(
-			Rect::from_center_le( grid_origin, vec2i::one(max_radius / GameConst::cell_size + 2) ),
-			Rect::off_size({}, lc.get_size()) )
-		.map([&](vec2i p){
-			lc.mut_cell(p).tmp = -1;
-		});
+		f.area = calc_intersection(
+			Rect::from_center_le( grid_origin, vec2i::one(f.max_radius / GameConst::cell_size + 2) ),
+			Rect::off_size({}, lc.get_size()) );
+		
+		f.index.clear();
+		f.index.resize(f.area.size().area(), -1);
 		
 		// raycast
 		
-		for (size_t i = 0; i < origs_size; ++i)
+		for (size_t i = 0; i < f.origs_size; ++i)
 		{
 			vec2fp ray_dir = {1, 0};
 			ray_dir.fastrotate(i * ray_diff);
@@ -324,13 +376,15 @@ public:
 				
 				//
 				
-				auto& c = lc.mut_cell(grid_pos);
-				if (c.is_wall)
+				if (!f.area.contains_le(grid_pos) || lc.cref(grid_pos).is_wall)
 					break;
 				
-				if (c.tmp < 0)
+				vec2i ip = grid_pos - f.area.lower();
+				int& ci = f.index[ip.y * f.area.size().x + ip.x];
+				
+				if (ci < 0)
 				{
-					c.tmp = cells.size();
+					ci = cells.size();
 					
 					auto& n = cells.emplace_back();
 					n.i0 = i;
@@ -339,28 +393,21 @@ public:
 				}
 				else
 				{
-					auto& n = cells[c.tmp];
+					auto& n = cells[ci];
 					n.i1 = i + 1;
 				}
 			}
 		}
 		
 		// offset rays for 360-0 cell
-
-		if (cells.front().pos == cells.back().pos && cells.size() > 1)
+		
+		if (cells.size() > 1 && cells.front().pos == cells.back().pos)
 		{
-			int overlap = cells.back().n_rays();
+			int overlap = cells.back().i1 - cells.back().i0;
 			cells.pop_back();
-			
-			std::rotate(origs.rbegin(), origs.rbegin() + overlap, origs.rend());
-			ray_offset = -overlap * ray_diff;
+			f.ray_offset = -overlap * ray_diff;
 		}
-		else ray_offset = 0;
-		
-		// calculate distance
-		
-		for (auto& c : cells)
-			c.dist = lc.to_center_coord(c.pos).dist(origin_pos);
+		else f.ray_offset = 0;
 	}
 	void place_end() override
 	{
@@ -426,8 +473,8 @@ public:
 				int n = 0;
 				for (auto& d : AI_Const::placement_crowd_dirs)
 				{
-					if (auto c = lc.cell(p + d))
-						n += c->tmp;
+					if (auto c = find_cell(p + d); c && c->occupied)
+						++n;
 				}
 				return n;
 			};
@@ -470,7 +517,7 @@ public:
 				float angdiff = modulo_dist<float>(optimal_ray, c.i_mid(), origs_size) / (origs_size /2);
 				
 				// normalized crowd
-				float crowd = float(num_crowded(c.pos)) / (std::size(AI_Const::placement_crowd_dirs) /2);
+				float crowd = float(num_crowded(c.pos())) / (std::size(AI_Const::placement_crowd_dirs) /2);
 				
 				// normalized distance difference
 				float ddist = (c.dist - opt_dist) * dist_scale;
@@ -500,15 +547,17 @@ public:
 				int freerad = d->par.dpar->placement_freerad;
 				if (freerad) {
 					for (auto& c : cells) {
-						auto d = abs(c.pos - best->pos);
+						auto d = abs(c.pos() - best->pos());
 						if (d.x <= freerad || d.y <= freerad)
 							c.occupied = true;
 					}
 				}
 				
-				d->result.tar = lc.to_center_coord(best->pos);
+				d->result.tar = lc.to_center_coord(best->pos());
 			}
 		}
+		
+		dbg_time = TimeSpan::current() - dbg_time_begin;
 	}
 	void place_feed(const PlaceParam& pars) override {
 		reserve_more_block(drones_orig, 128);
@@ -530,7 +579,7 @@ public:
 			
 			clr |= 0x30;
 			
-			vec2fp p = lc.to_center_coord(c.pos);
+			vec2fp p = lc.to_center_coord(c.pos());
 			GamePresenter::get()->dbg_rect(Rectfp::from_center( p, vec2fp::one(GameConst::cell_size/2) ), clr);
 //			GamePresenter::get()->dbg_text(p, FMT_FORMAT("{:.1f}", c.dist));
 		}
@@ -540,6 +589,11 @@ public:
 			if (!d.result.tar)
 				GamePresenter::get()->dbg_rect(Rectfp::from_center( lc.to_center_coord(d.cpos), vec2fp::one(GameConst::cell_size/2) ), 0x00ff0040);
 		}
+		
+		if (field) {
+			GamePresenter::get()->dbg_text(origin_pos, FMT_FORMAT("AoS: {:.3f} ms\nfields: {} hits, {} misses",
+			                                                      dbg_time.micro() / 1000., dbg_hits, dbg_misses));
+		}
 	}
 };
 AI_AOS* AI_AOS::create(GameCore& core) {
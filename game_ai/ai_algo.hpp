@@ -6,20 +6,38 @@ class  AI_Drone;
 struct AI_DroneParams;
 
 /// Floodfills rooms, visiting each one only once, up to (excluding) max_depth. 
-/// Function receives room and depth (starting with 0 for initial room). 
+/// Uses LevelCtrRoom::radio_order, so rooms are visited in order of ascending distance. 
+/// Function receives room and distance (0 for initial room). 
 /// If function returns false, flood is stopped. 
-/// If random_dirs is true, order of flood expansion is changed at each step, using GameCore random
+/// If random_dirs is true, order of rooms with same distance is shuffled, using GameCore random
 void room_radio_flood(GameCore& core, vec2i pos, int max_depth, bool random_dirs, bool /*always_visit_adjacent*/,
                       callable_ref<bool(const LevelCtrRoom&, int)> f);
 
-/// Performs physics query over room, limited by AI online range
+/// Iterates online drones in room (using AI_Controller index), limited by AI online range
 void room_query(GameCore& core, const LevelCtrRoom& rm, callable_ref<bool(AI_Drone&)> f);
 
-/// Performs physics query over circle
+/// Iterates online drones inside circle (using AI_Controller index)
 void area_query(GameCore& core, vec2fp ctr, float radius, callable_ref<bool(AI_Drone&)> f);
 
-/// Floodfilled rings. Real target is considered inside only if it's past first and before last circles
-std::vector<std::vector<vec2fp>> calc_search_rings(GameCore& core, vec2fp ctr_pos, vec2fp real_target, bool& real_inside);
+/// Floodfilled rings around cell, at distances from AI_Const::search_ring_dist. 
+/// Immutable once calculated, shared via AI_Controller cache
+struct AI_SearchRings
+{
+	vec2i origin; ///< Cell
+	uint32_t cells_version; ///< See LevelControl::get_cells_version()
+	std::vector<std::vector<vec2fp>> rings;
+	
+	/// Real target is considered inside only if it's past first and before last circles
+	bool is_inside(vec2fp real_target) const;
+	
+private:
+	friend std::shared_ptr<AI_SearchRings> calc_search_rings(GameCore& core, vec2i origin);
+	Rect area;
+	std::vector<uint8_t> steps; ///< Flood step at which cell was reached, 0 if not reached or origin
+};
+
+/// Performs floodfill. Use AI_Controller::get_search_rings() instead
+std::shared_ptr<AI_SearchRings> calc_search_rings(GameCore& core, vec2i origin);
 
 /// Area-of-sight distribution
 class AI_AOS
@@ -77,6 +77,16 @@ const TimeSpan online_check_timeout = TimeSpan::seconds(0.5);
 /// How often group is updated (radio, area-of-sight)
 const TimeSpan group_update_timeout = TimeSpan::seconds(0.5);
 
+/// Max number of drone updates per step. 
+/// Drones which can't be delayed (battle, suspect etc) are always updated, but are counted first
+const int think_budget = 12;
+
+/// Delayed updates which are allowed per step even if budget is exceeded
+const int think_budget_min = 2;
+
+/// Minimal time between updates of Idle and Search drones
+const TimeSpan think_idle_period = TimeSpan::seconds(0.2);
+
 /// How often drone can call for help
 const TimeSpan helpcall_timeout = TimeSpan::seconds(5);
 
@@ -117,6 +127,18 @@ const float patrol_raycast_length = 5;
 /// If distance between locked and nearest targets is bigger, re-locks to nearest
 //const float target_switch_distance = 3;
 
+/// For how long LoS check result is reused if neither drone nor target moved
+const TimeSpan target_los_cache_timeout = TimeSpan::seconds(0.3);
+
+/// Max position change at which LoS check result is reused (squared)
+const float target_los_cache_dist_squ = 0.1 * 0.1;
+
+/// Minimal number of LoS checks in perception pass to run them on worker threads
+const size_t perception_parallel_min = 8;
+
+/// Minimal number of updated drones to run their queries on worker threads
+const size_t decide_parallel_min = 4;
+
 /// Range in which target is detected out of FoV (squared)
 const float target_hearing_range_squ = 4*4;
 
@@ -149,6 +171,9 @@ const TimeSpan retaliation_length = TimeSpan::seconds(0.3);
 
 
 
+/// Number of cached AoS visibility fields (one per origin cell)
+const size_t placement_field_cache = 4;
+
 /// Neighbour cells checked for crowding
 const vec2i placement_crowd_dirs[] =
 {
@@ -241,6 +266,9 @@ const TimeSpan search_point_wait_last = TimeSpan::seconds(8);
 /// Search rings distances
 const std::array<int, 2> search_ring_dist = {8, 24};
 
+/// Number of cached search rings (one per origin cell)
+const size_t search_rings_cache = 8;
+
 
 
 /// Max alive hunters at one time
@@ -37,20 +37,15 @@ bool AI_Movement::set_target(std::optional<vec2fp> new_tar, AI_Speed speed, std:
 		if (path && same(path->ps.back())) return false;
 		if (preq && same(preq->target)) return false;
 		
-		// check if target is behind wall
-		auto rc = ent.core.get_phy().raycast_nearest( conv(ent.get_pos()), conv(*new_tar),
-			{[](auto&, b2Fixture& f) {return f.GetBody()->GetType() == b2_staticBody;}},
-			ent.ref_pc().get_radius() + 0.1 );
+		if (!planned || !planned->is_for(ent.get_pos(), *new_tar, evade, hack_allow_unlimited_path))
+			planned = make_plan(*new_tar, evade, hack_allow_unlimited_path, nullptr, &ent.core.get_aic().stats);
 		
-		if (rc)
+		if (planned->path)
 		{
 			path.reset();
 			auto& p = preq.emplace();
 			p.target = *new_tar;
-			
-			std::optional<float> max_len;
-			if (hack_allow_unlimited_path) max_len = GameConst::cell_size * ent.core.get_lc().get_size().minmax().y;
-			p.req = PathRequest( ent.core, ent.get_pos(), *new_tar, max_len, evade );
+			p.req = PathRequest( std::move(*planned->path) );
 		}
 		else
 		{
@@ -59,6 +54,7 @@ bool AI_Movement::set_target(std::optional<vec2fp> new_tar, AI_Speed speed, std:
 			p.ps.push_back(*new_tar);
 			p.next = 0;
 		}
+		planned.reset();
 		preq_failed = false;
 	}
 	return false;
@@ -78,7 +74,11 @@ bool AI_Movement::has_failed() const
 }
 bool AI_Movement::is_same(vec2fp a, vec2fp b) const
 {
-	if (cur_spd == AI_Speed::SlowPrecise)
+	return is_same(a, b, cur_spd);
+}
+bool AI_Movement::is_same(vec2fp a, vec2fp b, AI_Speed speed) const
+{
+	if (speed == AI_Speed::SlowPrecise)
 		return a.dist_squ(b) < AI_Const::move_slowprecise_dist_squ;
 	return ent.core.get_lc().is_same_coord(a, b);
 }
@@ -88,6 +88,52 @@ std::optional<vec2fp> AI_Movement::get_target() const
 	if (preq) return preq->target;
 	return {};
 }
+bool AI_Movement::Plan::is_for(vec2fp from, vec2fp target, const std::optional<PathRequest::Evade>& evade, bool unlimited_path) const
+{
+	auto eq = [](vec2fp a, vec2fp b) {return a.x == b.x && a.y == b.y;};
+	if (!eq(this->from, from) || !eq(this->target, target) || this->unlimited_path != unlimited_path) return false;
+	if (!this->evade || !evade) return !this->evade && !evade;
+	return eq(this->evade->pos, evade->pos) && this->evade->radius == evade->radius && this->evade->added_cost == evade->added_cost;
+}
+std::optional<AI_Movement::Plan> AI_Movement::plan_target(vec2fp new_tar, AI_Speed speed, std::optional<PathRequest::Evade> evade,
+                                                          bool unlimited_path, PathSearch& aps) const
+{
+	// same checks as in set_target()
+	auto same = [&](vec2fp p) {return is_same(p, new_tar, speed);};
+	if (same(ent.get_pos())) return {};
+	if (path && same(path->ps.back())) return {};
+	if (preq && same(preq->target)) return {};
+	
+	return make_plan(new_tar, evade, unlimited_path, &aps, nullptr);
+}
+AI_Movement::Plan AI_Movement::make_plan(vec2fp new_tar, std::optional<PathRequest::Evade> evade, bool unlimited_path,
+                                         PathSearch* aps, AI_Stats* stats) const
+{
+	auto measure = [&](AI_Stats::Category c, auto f) {
+		if (!stats) return f();
+		return stats->measure(c, f);
+	};
+	
+	Plan p{ ent.get_pos(), new_tar, evade, unlimited_path, {} };
+	
+	// check if target is behind wall
+	auto rc = measure(AI_Stats::C_OP_RAYCAST, [&]{
+		return ent.core.get_phy().raycast_nearest( conv(p.from), conv(new_tar),
+			{[](auto&, b2Fixture& f) {return f.GetBody()->GetType() == b2_staticBody;}},
+			ent.ref_pc().get_radius() + 0.1 );
+	});
+	
+	if (rc)
+	{
+		std::optional<float> max_len;
+		if (unlimited_path) max_len = GameConst::cell_size * ent.core.get_lc().get_size().minmax().y;
+		
+		p.path = measure(AI_Stats::C_OP_PATH, [&]{
+			return PathRequest( ent.core, p.from, new_tar, max_len, evade, aps ).result();
+		});
+	}
+	return p;
+}
 void AI_Movement::on_unreg()
 {
 	ent.ref_phobj().body.SetLinearVelocity({0, 0});
@@ -133,6 +179,7 @@ vec2fp AI_Movement::calc_avoidance()
 	const float ray_dist = std::min( dir.fastlen(), max_ray_dist );
 	dir.norm();
 	
+	AI_Stats::Scope st_scope(ent.core.get_aic().stats, AI_Stats::C_OP_RAYCAST);
 	auto rc = ent.core.get_phy().raycast_nearest( conv(self), conv(self + dir * ray_dist), {}, ray_width );
 	if (!rc || !rc->ent->get_ai_drone()) return stat_avoid({});
 	
@@ -231,7 +278,7 @@ bool AI_Attack::shoot(Entity& target, float distance, Entity& self)
 	auto& wpn = self.ref_eqp().get_wpn();
 	
 	vec2fp p = target.get_pos();
-	vec2fp corr = p + correction(distance, wpn.info->bullet_speed, target);
+	vec2fp corr = p + correction(distance, wpn.info->bullet_speed, target, self.ref_ai_drone().rnd);
 	
 	if (!check_los(corr, target, self)) p = corr;
 	else if (auto ent = check_los(p, target, self))
@@ -249,7 +296,7 @@ bool AI_Attack::shoot(Entity& target, float distance, Entity& self)
 	}
 	return true;
 }
-vec2fp AI_Attack::correction(float distance, float bullet_speed, Entity& target)
+vec2fp AI_Attack::correction(float distance, float bullet_speed, Entity& target, RandomGen& rnd)
 {
 	const float acc_k = GameCore::step_len / AI_Const::attack_acc_adjust_time;
 	
@@ -263,11 +310,12 @@ vec2fp AI_Attack::correction(float distance, float bullet_speed, Entity& target)
 	}
 	
 	float ttr = distance / bullet_speed; // time to reach
-	ttr += target.core.get_random().range(AI_Const::attack_ttr_dev0, AI_Const::attack_ttr_dev1); // hack
+	ttr += rnd.range(AI_Const::attack_ttr_dev0, AI_Const::attack_ttr_dev1); // hack
 	return vel_acc * ttr;
 }
 Entity* AI_Attack::check_los(vec2fp pos, Entity& target, Entity& self)
 {
+	AI_Stats::Scope st_scope(self.core.get_aic().stats, AI_Stats::C_OP_RAYCAST);
 	auto rc = self.core.get_phy().raycast_nearest( conv(self.get_pos()), conv(pos), {}, AI_Const::attack_los_hwidth );
 	if (rc && rc->ent != &target) return rc->ent;
 	return nullptr;
@@ -291,48 +339,20 @@ std::optional<AI_TargetProvider::Target> AI_TargetProvider::get_target() const
 void AI_TargetProvider::step()
 {
 	const auto& pars = drone.get_pars();
-	const vec2fp pos = ent.get_pos();
 	
 	tar_sel.reset();
 	
-	if (auto plr = ent.core.get_pmg().get_ent();
-	    plr && ent.core.dbg_ai_see_plr)
+	if (auto p = ent.core.get_aic().get_perception(*this))
 	{
-		[&]{
-			Entity* tar_e = plr;
-			
-			if (pars.fov && fov_t)
-			{
-				vec2fp delta = tar_e->get_pos() - pos;
-				float dist = delta.len_squ();
-				float spd = tar_e->ref_pc().get_vel().len_squ();
-				
-				if (dist > AI_Const::target_hearing_range_squ && (
-				     spd < AI_Const::target_hearing_ext_spd_threshold_squ ||
-				     dist > AI_Const::target_hearing_ext_range_squ))
-				{
-					float a = delta.fastangle();
-					float fov = lerp(pars.fov->first, pars.fov->second, *fov_t);
-					if (std::fabs(wrap_angle( a - ent.ref_pc().get_angle() )) > fov)
-						return;
-				}
-			}
-			
-			auto d = ent.core.get_phy().los_check( pos, *tar_e );
-			if (!d) return;
-			
-			float range = is_battle && pars.dist_battle ? *pars.dist_battle : pars.dist_visible;
-			if (*d > std::max(range, pars.dist_suspect)) return;
-			
-			tar_sel = Target{ tar_e->index, *d > range, damage_by == tar_e->index, *d };
-		}();
+		float range = is_battle && pars.dist_battle ? *pars.dist_battle : pars.dist_visible;
+		tar_sel = Target{ p->eid, p->dist > range, damage_by == p->eid, p->dist };
 	}
 	
 	if (!tar_sel && damage_by)
 	{
 		if (Entity* tar_e = ent.core.get_ent(*damage_by))
 		{
-			float dist = tar_e->get_pos().dist(pos);
+			float dist = tar_e->get_pos().dist(ent.get_pos());
 			tar_sel = Target{ tar_e->index, dist > pars.dist_visible, true, dist };
 		}
 	}
@@ -430,11 +450,11 @@ void AI_RotationControl::update(AI_Drone& dr, std::optional<vec2fp> view_target,
 	}
 	else if (!tmo.is_positive())
 	{
-		tmo = TimeSpan::seconds(1.3 + 0.3 * dr.ent.core.get_random().range_n2());
+		tmo = TimeSpan::seconds(1.3 + 0.3 * dr.rnd.range_n2());
 		
 		if (state == ST_RANDOM) reset(ST_WAIT);
 		else {
-			set_tar(dr.ent.core.get_random().range_n2() * M_PI, tmo);
+			set_tar(dr.rnd.range_n2() * M_PI, tmo);
 			state = ST_RANDOM;
 		}
 	}
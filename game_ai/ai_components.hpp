@@ -5,6 +5,9 @@
 #include "game/level_ctr.hpp"
 #include "ai_common.hpp"
 
+struct AI_Stats;
+struct RandomGen;
+
 // Note: components are NOT registered on initialization
 
 
@@ -27,6 +30,27 @@ struct AI_Movement final : EComp
 	bool is_same(vec2fp a, vec2fp b) const; ///< Checks if two coordinates refer to (roughly) same position
 	std::optional<vec2fp> get_target() const; ///< Returns current target, if any
 	
+	/// Results of world queries performed by set_target() for new target
+	struct Plan
+	{
+		vec2fp from, target;
+		std::optional<PathRequest::Evade> evade;
+		bool unlimited_path;
+		std::optional<PathRequest::Result> path; ///< Not set if target is directly reachable
+		
+		/// Returns true if made for same arguments
+		bool is_for(vec2fp from, vec2fp target, const std::optional<PathRequest::Evade>& evade, bool unlimited_path) const;
+	};
+	
+	/// Set by AI_Drone::decide(), used by set_target() instead of querying if it's for same target. 
+	/// Reset by AI_Drone after each update
+	std::optional<Plan> planned;
+	
+	/// Performs queries which set_target() would do for new target, without changing anything. 
+	/// Returns nothing if there is nothing to query. Thread-safe if 'aps' isn't used by anyone else
+	std::optional<Plan> plan_target(vec2fp new_tar, AI_Speed speed, std::optional<PathRequest::Evade> evade,
+	                                bool unlimited_path, PathSearch& aps) const;
+	
 	void on_unreg();
 	
 private:
@@ -47,6 +71,10 @@ private:
 	bool preq_failed = false;
 	
 	
+	bool is_same(vec2fp a, vec2fp b, AI_Speed speed) const;
+	Plan make_plan(vec2fp new_tar, std::optional<PathRequest::Evade> evade, bool unlimited_path,
+	               PathSearch* aps, AI_Stats* stats) const;
+	
 	vec2fp calc_avoidance();
 	vec2fp step_path();
 	void step() override;
@@ -76,7 +104,7 @@ private:
 	EntityIndex prev_tar;
 	vec2fp vel_acc = {};
 	
-	vec2fp correction(float distance, float bullet_speed, Entity& target);
+	vec2fp correction(float distance, float bullet_speed, Entity& target, RandomGen& rnd);
 	Entity* check_los(vec2fp pos, Entity& target, Entity& self); ///< Returns obstructing entity, if any
 };
 
@@ -95,6 +123,17 @@ struct AI_TargetProvider final : EComp
 	std::optional<float> fov_t = 0.f; ///< [0-1] FoV width (min -> max). If not set, FoV check ignored
 	bool is_battle = false;
 	
+	/// Used by AI_Controller perception pass
+	struct LosCache
+	{
+		EntityIndex eid;
+		vec2fp self, tar; ///< Positions
+		std::optional<float> dist;
+		TimeSpan time; ///< GameCore time
+	};
+	size_t perc_index = size_t_inval; ///< Index in AI_Controller perception table
+	LosCache los_cache;
+	
 	AI_TargetProvider(AI_Drone& drone); ///< Adds self!
 	
 	/// Returns visible primary or suspect target (also returns distance)
@@ -103,12 +142,14 @@ struct AI_TargetProvider final : EComp
 	/// Returns true if was damaged last step
 	bool was_damaged() const {return was_damaged_flag;}
 	
+	AI_Drone& get_drone() const {return drone;}
+	
+	static bool is_primary(Entity& ent) {return ent.is_creature();}
+	
 protected:
 	EVS_SUBSCR;
 	AI_Drone& drone;
 	
-	bool is_primary(Entity& ent) const {return ent.is_creature();}
-	
 private:
 	std::optional<Target> tar_sel;
 	std::optional<EntityIndex> damage_by;
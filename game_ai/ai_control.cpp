@@ -1,9 +1,15 @@
+#include <atomic>
+#include <condition_variable>
+#include <thread>
+#include "core/settings.hpp"
 #include "game/game_core.hpp"
 #include "game/game_info_list.hpp"
 #include "game/physics.hpp"
 #include "game/player_mgr.hpp"
 #include "game_objects/objs_creature.hpp"
 #include "utils/noise.hpp"
+#include "utils/path_search.hpp"
+#include "vaslib/vas_file.hpp"
 #include "vaslib/vas_log.hpp"
 #include "ai_algo.hpp"
 #include "ai_drone.hpp"
@@ -36,11 +42,13 @@ bool AI_Group::init_search(GameCore& core, const std::vector<AI_Drone*>& drones,
 	if (!num)
 		return false;
 	
-	bool real_inside = false;
-	auto rings = calc_search_rings(core, target_pos, real_target_pos.value_or(vec2fp{}), real_inside);
+	auto rings_ptr = core.get_aic().get_search_rings(target_pos);
+	auto& rings = rings_ptr->rings;
 	if (rings.empty())
 		return false;
 	
+	bool real_inside = real_target_pos && rings_ptr->is_inside(*real_target_pos);
+	
 	float a_diff = 2*M_PI / num;
 	float a_cur = core.get_random().range_n2() * a_diff;
 	
@@ -226,6 +234,8 @@ void AI_Group::update()
 	
 	if (is_visible())
 	{
+		AI_Stats::Scope st_scope(core.get_aic().stats, AI_Stats::C_OP_AOS);
+		
 		auto is_ignored = [&](AI_Drone& d)
 		{
 			if (d.is_camper() && d.mov) return false;
@@ -439,6 +449,61 @@ struct HunterScanner
 
 
 
+const char* AI_Stats::get_name(Category c)
+{
+	switch (c)
+	{
+	case C_IDLE:           return "Idle";
+	case C_IDLE_RESOURCE:  return "IdleResource";
+	case C_SUSPECT:        return "Suspect";
+	case C_SEARCH:         return "Search";
+	case C_BATTLE:         return "Battle";
+	case C_PUPPET:         return "Puppet";
+	
+	case C_OP_LOS:         return "LoS";
+	case C_OP_RAYCAST:     return "Raycast";
+	case C_OP_PATH:        return "PathRequest";
+	case C_OP_ROOM_QUERY:  return "Room query";
+	case C_OP_RADIO_FLOOD: return "Radio flood";
+	case C_OP_AOS:         return "AoS";
+	case C_OP_DECIDE:      return "Decide";
+	
+	case C_TOTAL_COUNT: break;
+	}
+	return "INVALID";
+}
+void AI_Stats::finish_step()
+{
+	for (size_t i=0; i < cur.size(); ++i) {
+		total[i].time  += cur[i].time;
+		total[i].count += cur[i].count;
+	}
+	last = cur;
+	cur = {};
+	++total_steps;
+}
+bool AI_Stats::write_csv(const char *filename) const
+{
+	std::string s = "category,total_ms,total_count,avg_ms_per_step,avg_count_per_step\n";
+	const double k = total_steps ? 1. / total_steps : 0;
+	
+	for (size_t i=0; i < total.size(); ++i)
+	{
+		double ms = total[i].time.micro() / 1000.;
+		s += FMT_FORMAT("{},{:.3f},{},{:.5f},{:.3f}\n", get_name(static_cast<Category>(i)),
+		                ms, total[i].count, ms * k, total[i].count * k);
+	}
+	
+	if (!writefile(filename, s.data(), s.size())) {
+		VLOGE("AI_Stats::write_csv() failed - \"{}\"", filename);
+		return false;
+	}
+	VLOGI("AI_Stats::write_csv() written to \"{}\"", filename);
+	return true;
+}
+
+
+
 class AI_Controller_Impl : public AI_Controller
 {
 public:
@@ -446,6 +511,50 @@ public:
 	
 	std::vector<AI_Drone*> drs;
 	TimeSpan check_tmo; // online area check
+	size_t i_think = 0; // round-robin position for delayed updates
+	
+	struct RoomDrones {
+		Rect bounds; // cells for which room is nearest
+		std::vector<AI_Drone*> ds;
+	};
+	std::vector<RoomDrones> room_drs; // same indices as LevelControl rooms
+	float room_max_radius = 0; // of all drones ever added
+	
+	struct PercTarget {
+		Entity* ent;
+		vec2fp pos;
+		float spd_squ;
+		float radius;
+	};
+	struct PercPair {
+		AI_TargetProvider* prov;
+		const PercTarget* tar;
+		float dist_squ;
+		float max_dist; // LoS
+		bool cached;
+		std::optional<float> los;
+	};
+	uint32_t perc_step = 0; // step counter at which table was filled
+	std::vector<std::optional<Perception>> perc_table;
+	std::vector<PercTarget> perc_tars; // temporary
+	std::vector<PercPair> perc_pairs; // temporary
+	std::vector<std::shared_ptr<const AI_SearchRings>> rings_cache; // most recent first
+	
+	std::vector<size_t> perc_los; // indices of pairs for which LoS is checked
+	std::atomic<size_t> perc_next; // next index in perc_los or dec_drs
+	
+	uint32_t dec_step = 0; // step counter at which decide pass was done
+	std::vector<AI_Drone*> dec_drs; // drones updated on this step
+	std::vector<std::unique_ptr<PathSearch>> perc_aps; // copies of level path search, one per worker
+	uint32_t perc_aps_version = 0; // see LevelControl::get_aps_version()
+	
+	std::vector<std::thread> perc_thrs;
+	std::mutex perc_mx;
+	std::condition_variable perc_cv, perc_done_cv;
+	void (AI_Controller_Impl::*perc_func)(size_t) = nullptr; // batch function
+	uint32_t perc_job = 0; // incremented on each parallel batch
+	size_t perc_pending = 0; // workers not yet finished with batch
+	bool perc_exit = false;
 	
 	b2DynamicTree res_tree;
 	std::vector<std::unique_ptr<AI_SimResource>> res_list;
@@ -461,9 +570,46 @@ public:
 	
 	
 	
-	AI_Controller_Impl(GameCore& core): core(core) {}
+	AI_Controller_Impl(GameCore& core)
+		: core(core)
+	{
+		auto& lc = core.get_lc();
+		room_drs.resize( lc.get_rooms().size() );
+		for (size_t i=0; i < room_drs.size(); ++i)
+			room_drs[i].bounds = lc.ref_room(i).area;
+		
+		for (int y=0; y < lc.get_size().y; ++y)
+		for (int x=0; x < lc.get_size().x; ++x)
+		{
+			auto& c = lc.cref({x, y});
+			if (!c.is_wall) room_drs[c.room_nearest].bounds.enclose({x, y});
+		}
+		
+		int n_thr = std::max(0, AppSettings::get().ai_threads);
+		perc_aps.resize(n_thr);
+		for (int i=0; i < n_thr; ++i) {
+			perc_thrs.emplace_back([this, i]{
+				set_this_thread_name("AI worker");
+				perception_worker(i);
+			});
+		}
+	}
+	~AI_Controller_Impl()
+	{
+		std::unique_lock lock(perc_mx);
+		perc_exit = true;
+		perc_cv.notify_all();
+		lock.unlock();
+		
+		for (auto& t : perc_thrs) t.join();
+	}
 	void step() override
 	{
+		// room index
+		
+		for (auto& d : drs)
+			room_update(d);
+		
 		if (group_check_tmo.is_positive()) group_check_tmo -= GameCore::step_len;
 		else if (the_only_group) {
 			group_check_tmo = AI_Const::group_update_timeout;
@@ -481,18 +627,13 @@ public:
 			check_tmo = AI_Const::online_check_timeout;
 			
 			auto [r_on, r_off] = core.get_pmg().get_ai_rects();
-
-			core.get_phy().query_aabb(r_off, [](Entity& ent, auto&){
-				if (auto d = ent.get_ai_drone())
-					d->is_online |= 2;
-			});
-			core.get_phy().query_aabb(r_on, [](Entity& ent, auto&){
-				if (auto d = ent.get_ai_drone())
-					d->is_online |= 4;
-			});
 			
 			for (auto& d : drs)
 			{
+				vec2fp pos = d->ent.get_pos();
+				if (r_off.contains(pos)) d->is_online |= 2;
+				if (r_on .contains(pos)) d->is_online |= 4;
+				
 				if (d->always_online)
 				{
 					if (!(d->is_online & 1)) {
@@ -532,6 +673,31 @@ public:
 		}
 		erase_if(hunters, [&](auto& i) {return !core.get_ent(i);});
 		scanner.update(core, the_only_group ? &*the_only_group : nullptr);
+		
+		schedule_think();
+		stats.finish_step();
+	}
+	void schedule_think()
+	{
+		// urgent updates from this step are used as estimate for the next one
+		int left = std::max(AI_Const::think_budget_min, think_budget - think_urgent_count);
+		
+		debug_think_number = think_count;
+		think_count = 0;
+		think_urgent_count = 0;
+		
+		for (size_t n = 0; n < drs.size() && left > 0; ++n)
+		{
+			i_think = (i_think + 1) % drs.size();
+			
+			auto d = drs[i_think];
+			if (d->is_online && !d->think_sched && !d->is_think_urgent() &&
+			    d->think_passed + GameCore::step_len >= AI_Const::think_idle_period)
+			{
+				d->think_sched = true;
+				--left;
+			}
+		}
 	}
 	AI_GroupPtr get_group(AI_Drone& drone) override
 	{
@@ -550,7 +716,7 @@ public:
 			bool ret = true;
 			std::optional<std::pair<AI_Drone*, float>> best;
 			
-			room_query(core, room,
+			::room_query(core, room,
 			[&](AI_Drone& d)
 			{
 				if (!d.is_online || &d == &drone || d.is_camper() || d.get_pars().helpcall == AI_DroneParams::HELP_NEVER)
@@ -609,6 +775,304 @@ public:
 	{
 		g_susp = 1;
 	}
+	std::optional<Perception> get_perception(AI_TargetProvider& prov) override
+	{
+		if (perc_step != core.get_step_counter()) perception_update();
+		if (prov.perc_index < perc_table.size()) return perc_table[prov.perc_index];
+		return {};
+	}
+	void perception_update()
+	{
+		perc_step = core.get_step_counter();
+		perc_table.clear();
+		
+		debug_los_number = 0;
+		debug_los_cached = 0;
+		
+		// gather targets (only player is targeted for now)
+		
+		perc_tars.clear();
+		if (auto plr = core.get_pmg().get_ent(); plr && core.dbg_ai_see_plr)
+		{
+			auto& t = perc_tars.emplace_back();
+			t.ent = plr;
+			t.pos = plr->get_pos();
+			t.spd_squ = plr->ref_pc().get_vel().len_squ();
+			t.radius = plr->ref_pc().get_radius();
+		}
+		
+		// cheap checks - range and FoV
+		
+		perc_pairs.clear();
+		for (auto& d : drs)
+		{
+			auto& prov = d->get_prov();
+			if (!d->is_online) {
+				prov.perc_index = size_t_inval;
+				continue;
+			}
+			
+			prov.perc_index = perc_table.size();
+			perc_table.emplace_back();
+			if (perc_tars.empty()) continue;
+			
+			const auto& pars = d->get_pars();
+			const vec2fp pos = d->ent.get_pos();
+			
+			float range = prov.is_battle && pars.dist_battle ? *pars.dist_battle : pars.dist_visible;
+			float max_dist = std::max(range, pars.dist_suspect);
+			
+			for (auto& t : perc_tars)
+			{
+				vec2fp delta = t.pos - pos;
+				float dist = delta.len_squ();
+				
+				// LoS distance is to the target surface
+				float max_ctr = max_dist + t.radius;
+				if (dist > max_ctr * max_ctr) continue;
+				
+				if (pars.fov && prov.fov_t)
+				{
+					if (dist > AI_Const::target_hearing_range_squ && (
+					     t.spd_squ < AI_Const::target_hearing_ext_spd_threshold_squ ||
+					     dist > AI_Const::target_hearing_ext_range_squ))
+					{
+						float a = delta.fastangle();
+						float fov = lerp(pars.fov->first, pars.fov->second, *prov.fov_t);
+						if (std::fabs(wrap_angle( a - d->ent.ref_pc().get_angle() )) > fov)
+							continue;
+					}
+				}
+				
+				perc_pairs.push_back({ &prov, &t, dist, max_dist });
+			}
+		}
+		
+		// select LoS checks which can't be taken from cache
+		
+		std::stable_sort(perc_pairs.begin(), perc_pairs.end(),
+		                 [](auto& a, auto& b) {return a.dist_squ < b.dist_squ;});
+		
+		const auto now = core.get_step_time();
+		perc_los.clear();
+		
+		for (size_t i=0; i < perc_pairs.size(); ++i)
+		{
+			auto& p = perc_pairs[i];
+			const vec2fp pos = p.prov->ent.get_pos();
+			auto& lc = p.prov->los_cache;
+			
+			p.cached = lc.eid == p.tar->ent->index &&
+			           now - lc.time < AI_Const::target_los_cache_timeout &&
+			           lc.self.dist_squ(pos)        < AI_Const::target_los_cache_dist_squ &&
+			           lc.tar .dist_squ(p.tar->pos) < AI_Const::target_los_cache_dist_squ;
+			
+			if (p.cached) ++debug_los_cached;
+			else perc_los.push_back(i);
+		}
+		
+		// LoS checks are independent and world isn't changed meanwhile, 
+		// so they are performed in parallel
+		
+		debug_los_number = perc_los.size();
+		perc_next = 0;
+		const TimeSpan los_t0 = TimeSpan::current();
+		
+		if (perc_los.size() >= AI_Const::perception_parallel_min) run_parallel(&AI_Controller_Impl::perception_los);
+		else perception_los(perc_thrs.size());
+		
+		stats.add(AI_Stats::C_OP_LOS, TimeSpan::current() - los_t0, perc_los.size());
+		
+		// apply results, nearest first
+		
+		for (auto& p : perc_pairs)
+		{
+			auto& lc = p.prov->los_cache;
+			if (!p.cached)
+			{
+				lc.eid  = p.tar->ent->index;
+				lc.self = p.prov->ent.get_pos();
+				lc.tar  = p.tar->pos;
+				lc.dist = p.los;
+				lc.time = now;
+			}
+			
+			auto& res = perc_table[p.prov->perc_index];
+			if (res) continue; // nearer target is already visible
+			
+			if (lc.dist && *lc.dist <= p.max_dist)
+				res = Perception{ p.tar->ent->index, *lc.dist };
+		}
+	}
+	void perception_los(size_t)
+	{
+		for (size_t i; (i = perc_next++) < perc_los.size(); )
+		{
+			auto& p = perc_pairs[perc_los[i]];
+			p.los = core.get_phy().los_check( p.prov->ent.get_pos(), *p.tar->ent );
+		}
+	}
+	void decide_update() override
+	{
+		if (dec_step == core.get_step_counter()) return;
+		dec_step = core.get_step_counter();
+		
+		// Queries are read-only and world isn't changed meanwhile, so they are performed in parallel. 
+		// Drones are then updated in usual order, using results of these queries
+		
+		dec_drs.clear();
+		for (auto& d : drs) {
+			if (d->is_online && (d->think_sched || d->is_think_urgent()))
+				dec_drs.push_back(d);
+		}
+		
+		perc_next = 0;
+		const TimeSpan t0 = TimeSpan::current();
+		
+		if (dec_drs.size() >= AI_Const::decide_parallel_min && !perc_thrs.empty())
+		{
+			auto& lc = core.get_lc();
+			if (perc_aps_version != lc.get_aps_version() || !perc_aps[0])
+			{
+				perc_aps_version = lc.get_aps_version();
+				for (auto& p : perc_aps) p.reset( lc.get_aps().clone() );
+			}
+			
+			run_parallel(&AI_Controller_Impl::decide_drones);
+			
+			for (auto& p : perc_aps) {
+				lc.get_aps().debug_time += p->debug_time;
+				lc.get_aps().debug_request_count += p->debug_request_count;
+				p->debug_time = {};
+				p->debug_request_count = 0;
+			}
+		}
+		else decide_drones(perc_thrs.size());
+		
+		stats.add(AI_Stats::C_OP_DECIDE, TimeSpan::current() - t0, dec_drs.size());
+	}
+	void decide_drones(size_t worker)
+	{
+		auto& aps = worker < perc_aps.size() ? *perc_aps[worker] : core.get_lc().get_aps();
+		for (size_t i; (i = perc_next++) < dec_drs.size(); )
+			dec_drs[i]->decide(aps);
+	}
+	/// Runs function on all workers and current thread (which has index equal to number of workers)
+	void run_parallel(void (AI_Controller_Impl::*func)(size_t))
+	{
+		if (perc_thrs.empty()) {
+			(this->*func)(0);
+			return;
+		}
+		
+		std::unique_lock lock(perc_mx);
+		perc_func = func;
+		perc_pending = perc_thrs.size();
+		++perc_job;
+		perc_cv.notify_all();
+		lock.unlock();
+		
+		(this->*func)(perc_thrs.size());
+		
+		lock.lock();
+		perc_done_cv.wait(lock, [this]{return perc_pending == 0;});
+	}
+	void perception_worker(size_t index)
+	{
+		uint32_t job = 0;
+		while (true)
+		{
+			std::unique_lock lock(perc_mx);
+			perc_cv.wait(lock, [&]{return perc_exit || perc_job != job;});
+			if (perc_exit) break;
+			job = perc_job;
+			auto func = perc_func;
+			lock.unlock();
+			
+			(this->*func)(index);
+			
+			lock.lock();
+			if (!--perc_pending) perc_done_cv.notify_one();
+		}
+	}
+	std::shared_ptr<const AI_SearchRings> get_search_rings(vec2fp ctr) override
+	{
+		auto& lc = core.get_lc();
+		const vec2i origin = lc.to_cell_coord(ctr);
+		
+		for (size_t i=0; i < rings_cache.size(); ++i)
+		{
+			auto& r = rings_cache[i];
+			if (r->origin == origin && r->cells_version == lc.get_cells_version())
+			{
+				++debug_rings_reused;
+				std::rotate(rings_cache.begin(), rings_cache.begin() + i, rings_cache.begin() + i + 1);
+				return rings_cache.front();
+			}
+		}
+		
+		++debug_rings_calc;
+		if (rings_cache.size() == AI_Const::search_rings_cache) rings_cache.pop_back();
+		rings_cache.insert(rings_cache.begin(), calc_search_rings(core, origin));
+		return rings_cache.front();
+	}
+	void room_query(size_t room_index, callable_ref<bool(AI_Drone&)> f) override
+	{
+		AI_Stats::Scope st_scope(stats, AI_Stats::C_OP_ROOM_QUERY);
+		auto& lc = core.get_lc();
+		auto& room = lc.ref_room(room_index);
+		const Rectfp fp_area = room.fp_area();
+		
+		// same as physics query by room area: drone near the edge may be indexed by adjacent room
+		
+		auto query = [&](const RoomDrones& rm)
+		{
+			for (size_t i=0; i < rm.ds.size(); ++i)
+			{
+				auto& d = *rm.ds[i];
+				if (!d.is_online) continue;
+				
+				vec2fp half = vec2fp::one( d.ent.ref_pc().get_radius() );
+				if (fp_area.overlaps( Rectfp::from_center(d.ent.get_pos(), half) ) && !f(d))
+					return false;
+			}
+			return true;
+		};
+		if (!query( room_drs.at(room_index) )) return;
+		
+		const vec2i margin = vec2i::one( std::ceil(room_max_radius / GameConst::cell_size) );
+		const Rect area = Rect::bounds( room.area.lower() - margin, room.area.upper() + margin );
+		
+		for (size_t i=0; i < room_drs.size(); ++i)
+		{
+			auto& rm = room_drs[i];
+			if (i != room_index && !rm.ds.empty() && rm.bounds.intersects(area) && !query(rm))
+				return;
+		}
+	}
+	void area_query(vec2fp ctr, float radius, callable_ref<bool(AI_Drone&)> f) override
+	{
+		AI_Stats::Scope st_scope(stats, AI_Stats::C_OP_ROOM_QUERY);
+		auto& lc = core.get_lc();
+		Rect area = Rect::bounds( lc.to_cell_coord(ctr - vec2fp::one(radius)),
+		                          lc.to_cell_coord(ctr + vec2fp::one(radius)) + vec2i::one(1) );
+		
+		for (auto& rm : room_drs)
+		{
+			if (rm.ds.empty() || !rm.bounds.intersects(area))
+				continue;
+			
+			for (size_t i=0; i < rm.ds.size(); ++i)
+			{
+				auto& d = *rm.ds[i];
+				if (!d.is_online) continue;
+				
+				float r = radius + d.ent.ref_pc().get_radius();
+				if (d.ent.get_pos().dist_squ(ctr) < r*r && !f(d))
+					return;
+			}
+		}
+	}
 	
 	
 	
@@ -619,13 +1083,36 @@ public:
 	void ref_drone(AI_Drone* d) override
 	{
 		drs.push_back(d);
+		room_max_radius = std::max(room_max_radius, d->ent.ref_pc().get_radius());
 		scanner.ref(d);
+		room_update(d);
 	}
 	void unref_drone(AI_Drone* d) override
 	{
 		auto it = std::find(drs.begin(), drs.end(), d);
 		drs.erase(it);
 		scanner.unref(d);
+		
+		if (d->room_index != size_t_inval)
+			erase_if_find(room_drs[d->room_index].ds, d);
+	}
+	void room_update(AI_Drone* d)
+	{
+		auto& lc = core.get_lc();
+		vec2i pos = lc.to_cell_coord(d->ent.get_pos());
+		
+		auto c = lc.cell(pos);
+		if (!c) return;
+		
+		size_t ri = c->room_nearest;
+		room_drs[ri].bounds.enclose(pos); // cell may have been a wall on init
+		if (ri == d->room_index) return;
+		
+		if (d->room_index != size_t_inval)
+			erase_if_find(room_drs[d->room_index].ds, d);
+		
+		d->room_index = ri;
+		room_drs[ri].ds.push_back(d);
 	}
 	int ref_resource(Rectfp p, AI_SimResource* r) override
 	{
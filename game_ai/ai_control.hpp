@@ -7,6 +7,8 @@
 class  AI_AOS;
 struct AI_GroupPtr;
 class  AI_SimResource;
+struct AI_SearchRings;
+struct AI_TargetProvider;
 
 
 
@@ -66,12 +68,91 @@ private:
 
 
 
+/// AI cost accounting, by drone state and by operation type
+struct AI_Stats
+{
+	enum Category
+	{
+		// time in AI_Drone::think(), by state
+		C_IDLE,
+		C_IDLE_RESOURCE,
+		C_SUSPECT,
+		C_SEARCH,
+		C_BATTLE,
+		C_PUPPET,
+		
+		// operations
+		C_OP_LOS,
+		C_OP_RAYCAST,
+		C_OP_PATH,
+		C_OP_ROOM_QUERY,
+		C_OP_RADIO_FLOOD,
+		C_OP_AOS,
+		C_OP_DECIDE, ///< Queries done in advance for drone updates (see AI_Drone::decide), wall time
+		
+		C_TOTAL_COUNT ///< Do not use
+	};
+	struct Entry
+	{
+		TimeSpan time;
+		size_t count = 0;
+	};
+	
+	/// Measures time until destroyed
+	struct Scope
+	{
+		Scope(AI_Stats& st, Category c): st(st), c(c), t0(TimeSpan::current()) {}
+		~Scope() {st.add(c, TimeSpan::current() - t0);}
+		
+	private:
+		AI_Stats& st;
+		Category c;
+		TimeSpan t0;
+	};
+	
+	std::array<Entry, C_TOTAL_COUNT> last; ///< Last complete step
+	std::array<Entry, C_TOTAL_COUNT> total; ///< Since level start
+	size_t total_steps = 0;
+	
+	static const char* get_name(Category c);
+	
+	/// Calls function, measuring time
+	template <typename F>
+	auto measure(Category c, F f) {
+		Scope sc(*this, c);
+		return f();
+	}
+	
+	void add(Category c, TimeSpan time, size_t count = 1) {
+		cur[c].time += time;
+		cur[c].count += count;
+	}
+	void finish_step(); ///< Moves current step values into last and total
+	
+	/// Writes totals as CSV table. Returns false on error
+	bool write_csv(const char *filename) const;
+	
+private:
+	std::array<Entry, C_TOTAL_COUNT> cur;
+};
+
+
+
 class AI_Controller
 {
 public:
+	AI_Stats stats;
+	
 	bool show_aos_debug = false;
 	bool show_states_debug = false;
 	size_t debug_batle_number = 0;
+	size_t debug_think_number = 0; ///< Drone updates on last step
+	size_t debug_los_number = 0; ///< Perception LoS checks on last step
+	size_t debug_los_cached = 0; ///< Perception LoS checks skipped on last step
+	size_t debug_rings_calc = 0; ///< Search rings floodfills performed, total
+	size_t debug_rings_reused = 0; ///< Search rings floodfills avoided, total
+	
+	int think_budget = AI_Const::think_budget; ///< See AI_Const::think_budget
 	
 	static AI_Controller* create(GameCore& core);
 	virtual ~AI_Controller() = default;
@@ -91,6 +172,27 @@ public:
 	/// Sets maximum level
 	virtual void trigger_global_suspicion() = 0;
 	
+	struct Perception
+	{
+		EntityIndex eid; ///< Visible target
+		float dist; ///< LoS distance
+	};
+	
+	/// Returns target in range and FoV of online drone, if it's visible. 
+	/// On first call in a step performs perception pass for all online drones
+	virtual std::optional<Perception> get_perception(AI_TargetProvider& prov) = 0;
+	
+	/// Returns search rings around cell containing position. 
+	/// Result is cached and shared between all callers for same cell
+	virtual std::shared_ptr<const AI_SearchRings> get_search_rings(vec2fp ctr) = 0;
+	
+	/// Calls function for each online drone overlapping room area. 
+	/// If function returns false, query is stopped
+	virtual void room_query(size_t room_index, callable_ref<bool(AI_Drone&)> f) = 0;
+	
+	/// Calls function for each online drone inside circle. If function returns false, query is stopped
+	virtual void area_query(vec2fp ctr, float radius, callable_ref<bool(AI_Drone&)> f) = 0;
+	
 protected:
 	friend AI_Drone;
 	friend AI_GroupPtr;
@@ -105,6 +207,13 @@ protected:
 	virtual void find_resource(Rectfp p, callable_ref<void(AI_SimResource&)> f) = 0;
 	
 	virtual void mark_scan_failed() = 0;
+	
+	/// On first call in a step calls AI_Drone::decide() for all drones which will be updated
+	virtual void decide_update() = 0;
+	
+	// updated by AI_Drone
+	int think_count = 0;
+	int think_urgent_count = 0;
 };
 
 #endif // AI_GROUP_HPP
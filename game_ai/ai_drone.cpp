@@ -32,6 +32,17 @@ void AI_Drone::Battle::reset_firstshot()
 
 
 
+static PathRequest::Evade placement_evade(vec2fp last_pos)
+{
+	PathRequest::Evade evade;
+	evade.pos = last_pos;
+	evade.radius     = AI_Const::placement_follow_evade_radius;
+	evade.added_cost = AI_Const::placement_follow_evade_cost;
+	return evade;
+}
+
+
+
 AI_Drone::AI_Drone(Entity& ent, std::shared_ptr<AI_DroneParams> pars, IdleState idle, std::unique_ptr<AI_AttackPattern> atkpat)
 	:
 	EComp(ent),
@@ -44,6 +55,7 @@ AI_Drone::AI_Drone(Entity& ent, std::shared_ptr<AI_DroneParams> pars, IdleState
 	home_point = ent.get_pos();
 	ent.core.get_aic().ref_drone(this);
 	ent.ref_pc().rot_override = ent.core.get_random().range_n2() * M_PI;
+	rnd.set_seed( ent.core.seed ^ (ent.index.to_int() * 0x9e3779b9) ^ (ent.core.get_step_counter() * 0x85ebca6b) );
 }
 AI_Drone::~AI_Drone()
 {
@@ -64,6 +76,9 @@ void AI_Drone::set_online(bool is)
 	
 	if (is_online)
 	{
+		think_sched = false;
+		think_passed = {};
+		
 		reg(ECompType::StepLogic);
 		prov.reg(ECompType::StepPreUtil);
 		if (mov) mov->reg(ECompType::StepPostUtil);
@@ -230,11 +245,65 @@ void AI_Drone::helpcall(std::optional<vec2fp> target, bool high_prio)
 		ent.core.get_aic().help_call(*this, target, high_prio);
 	}
 }
+bool AI_Drone::is_think_urgent() const
+{
+	if (prov.get_target() || prov.was_damaged())
+		return true;
+	
+	auto& state = state_stack.back();
+	if (auto gst = std::get_if<Idle>(&state))
+	{
+		auto st = std::get_if<IdleResource>(&gst->ist);
+		return st && st->reg.is_reg(); // must be processed at each step
+	}
+	return !std::holds_alternative<Search>(state);
+}
 void AI_Drone::step()
 {
-	if (ent.core.get_aic().show_states_debug)
+	auto& aic = ent.core.get_aic();
+	if (aic.show_states_debug)
 		GamePresenter::get()->dbg_text(ent.get_pos(), get_dbg_state(), 0xffff'ff80);
 	
+	aic.decide_update(); // before changing anything
+	think_passed += GameCore::step_len;
+	
+	bool urgent = is_think_urgent();
+	if (urgent || think_sched)
+	{
+		think_sched = false;
+		++aic.think_count;
+		if (urgent) ++aic.think_urgent_count;
+		
+		auto st_cat = std::visit(overloaded{
+			[](Idle& st) {
+				return std::holds_alternative<IdleResource>(st.ist) ? AI_Stats::C_IDLE_RESOURCE : AI_Stats::C_IDLE;
+			},
+			[](Battle&)  {return AI_Stats::C_BATTLE;},
+			[](Suspect&) {return AI_Stats::C_SUSPECT;},
+			[](Search&)  {return AI_Stats::C_SEARCH;},
+			[](Puppet&)  {return AI_Stats::C_PUPPET;}
+		}, get_state());
+		
+		AI_Stats::Scope st_scope(aic.stats, st_cat);
+		think(think_passed);
+		think_passed = {};
+	}
+	
+	// results of decide() are valid only for this step
+	planned_ray.reset();
+	if (mov) mov->planned.reset();
+	
+	// rotate
+	
+	rot_ctl.update(*this, rot_target, mov ? mov->get_next_point() : std::optional<vec2fp>{});
+	
+	auto& body = ent.ref_phobj().body;
+	float nextAngle = body.GetAngle() + body.GetAngularVelocity() * GameCore::time_mul;
+	float tar_torq = angle_delta(*ent.ref_pc().rot_override, nextAngle);
+	body.ApplyAngularImpulse( body.GetInertia() * tar_torq / GameCore::time_mul, true );
+}
+void AI_Drone::think(TimeSpan passed)
+{
 	std::optional<float> tar_dist; ///< Set if seen
 	bool damaged_by_tar = false;
 	
@@ -281,11 +350,11 @@ void AI_Drone::step()
 	
 	if (damaged_by_tar) retaliation_tmo = AI_Const::retaliation_length;
 	else if (retaliation_tmo.is_positive())
-		retaliation_tmo -= GameCore::step_len;
+		retaliation_tmo -= passed;
 	
 	//
 	
-	std::optional<vec2fp> rot_target; // set to what should be facing now
+	rot_target.reset();
 	
 	auto reached = [this](TimeSpan t) {
 		return t <= ent.core.get_step_time();
@@ -297,12 +366,7 @@ void AI_Drone::step()
 	{
 		auto goto_placement = [&]
 		{
-			PathRequest::Evade evade;
-			evade.pos = st->grp->get_last_pos();
-			evade.radius     = AI_Const::placement_follow_evade_radius;
-			evade.added_cost = AI_Const::placement_follow_evade_cost;
-			
-			if (mov->set_target( st->placement, AI_Speed::Normal, evade ))
+			if (mov->set_target( st->placement, AI_Speed::Normal, placement_evade(st->grp->get_last_pos()) ))
 			    st->placement = {};
 		};
 		
@@ -314,7 +378,7 @@ void AI_Drone::step()
 			
 			st->grp->report_seen();
 			st->not_visible = {};
-			st->chase_wait = std::min(1., st->chase_wait + GameCore::step_len / AI_Const::chase_wait_incr);
+			st->chase_wait = std::min(1., st->chase_wait + passed / AI_Const::chase_wait_incr);
 			
 			const float atk_range = pars->dist_battle.value_or( pars->dist_visible );
 			if ((*tar_dist <= atk_range && *tar_dist >= pars->dist_panic && reached(st->firstshot_time))
@@ -331,16 +395,7 @@ void AI_Drone::step()
 				if (st->placement) goto_placement();
 				else if (*tar_dist < pars->dist_minimal)
 				{
-					const vec2fp delta = t_pos - ent.get_pos();
-					const float da = delta.angle();
-					
-					vec2fp pos = ent.get_pos();
-					vec2fp tar = t_pos + (delta / *tar_dist) * -pars->dist_minimal;
-					
-					auto rc = ent.core.get_phy().raycast_nearest( conv(pos), conv(tar) );
-					if (rc) tar = conv(rc->poi);
-					tar -= vec2fp( ent.ref_pc().get_radius() + 0.1, 0 ).rotate( da );
-					
+					vec2fp tar = retreat_target(t_pos, *tar_dist);
 					if (*tar_dist >= pars->dist_panic) mov->set_target( tar, AI_Speed::Slow );
 					else {
 						tar_dist.reset();
@@ -349,14 +404,7 @@ void AI_Drone::step()
 				}
 				else if (*tar_dist > pars->dist_optimal)
 				{
-					const vec2fp delta = t_pos - ent.get_pos();
-					const float da = delta.angle();
-					
-					vec2fp pos = ent.get_pos();
-					vec2fp tar = pos + (delta / *tar_dist) * pars->dist_optimal;
-					
-					tar += vec2fp( ent.ref_pc().get_radius(), 0 ).rotate( da );
-					mov->set_target( tar, AI_Speed::Accel );
+					mov->set_target( approach_target(t_pos, *tar_dist), AI_Speed::Accel );
 				}
 				else mov->set_target({});
 			}
@@ -374,7 +422,7 @@ void AI_Drone::step()
 			}
 			if (atk.atkpat) atk.atkpat->idle(ent);
 			
-			st->not_visible += GameCore::step_len;
+			st->not_visible += passed;
 			
 			if (st->placement)
 			{
@@ -382,7 +430,7 @@ void AI_Drone::step()
 			}
 			else if (st->chase_wait > 0)
 			{
-				st->chase_wait -= GameCore::step_len / AI_Const::chase_wait_decr;
+				st->chase_wait -= passed / AI_Const::chase_wait_decr;
 				if (mov) mov->set_target({});
 			}
 			else if (!is_camper())
@@ -394,17 +442,9 @@ void AI_Drone::step()
 					if (mov->set_target( tar, AI_Speed::Accel ))
 						st->grp->init_search(); // may cause stops when someone is chasing ahead, but should prevent deadlocks
 				}
-				else if (!mov->has_target() || st->not_visible <= GameCore::step_len) // chase ahead
+				else if (!mov->has_target() || st->not_visible <= passed) // chase ahead
 				{
-					vec2fp dir = tar - ent.get_pos();
-					if (dir.len_squ() > 1)
-					{
-						dir.norm_to( AI_Const::chase_ahead_dist );
-						if (auto rc = ent.core.get_phy().raycast_nearest( conv(tar), conv(tar + dir) ))
-							dir = conv(rc->poi) - tar;
-					}
-					tar += dir;
-					
+					tar = chase_ahead_target(tar);
 					if (mov->set_target( tar, AI_Speed::Accel ) || mov->has_failed())
 						st->grp->init_search();
 				}
@@ -419,7 +459,7 @@ void AI_Drone::step()
 		if (tar_dist)
 		{
 			st->was_visible = true;
-			st->level += GameCore::step_len / (tar_dist < pars->dist_visible ? AI_Const::suspect_incr_close : AI_Const::suspect_incr);
+			st->level += passed / (tar_dist < pars->dist_visible ? AI_Const::suspect_incr_close : AI_Const::suspect_incr);
 			
 			if (st->level > 1) set_battle_state();
 			else if (!is_camper())
@@ -438,7 +478,7 @@ void AI_Drone::step()
 		else
 		{
 			st->was_visible = false;
-			st->level -= GameCore::step_len / AI_Const::suspect_decr;
+			st->level -= passed / AI_Const::suspect_decr;
 			if (mov && mov->has_target()) st->level = std::max(st->level, AI_Const::suspect_chase_thr);
 			else if (st->level < 0) remove_state();
 		}
@@ -446,11 +486,11 @@ void AI_Drone::step()
 	else if (auto st = std::get_if<Search>(&get_state()))
 	{
 		if (st->susp_level > 0)
-			st->susp_level -= GameCore::step_len / AI_Const::suspect_decr;
+			st->susp_level -= passed / AI_Const::suspect_decr;
 		
 		if (st->tmo.is_positive())
 		{
-			st->tmo -= GameCore::step_len;
+			st->tmo -= passed;
 			if (!st->tmo.is_positive())
 			{
 				bool last = st->at == st->pts.size() - 1;
@@ -513,7 +553,7 @@ void AI_Drone::step()
 						if (!particles->is_playing())
 						{
 							if (st->particle_tmo.is_positive())
-								st->particle_tmo -= GameCore::step_len;
+								st->particle_tmo -= passed;
 							else {
 								float len = ent.ref_pc().get_radius();
 								if (st->is_loading)
@@ -534,7 +574,7 @@ void AI_Drone::step()
 				}, res);
 			}
 			else if (st->reg_try_tmo.is_positive()) {
-				st->reg_try_tmo -= GameCore::step_len;
+				st->reg_try_tmo -= passed;
 			}
 			else {
 				if (st->is_loading) {
@@ -557,7 +597,6 @@ void AI_Drone::step()
 		{
 			const vec2fp pos = ent.get_pos();
 			const vec2fp npt = st->pts[st->at];
-			const vec2fp tar = pos + AI_Const::patrol_raycast_length * (npt - pos).norm();
 			
 			bool stop = false;
 			if (!st->reg)
@@ -573,25 +612,12 @@ void AI_Drone::step()
 			}
 			
 			// prevent crowding
-			if (!stop) {
-				auto cf = [](Entity& ent, auto&) {
-					return !!ent.get_ai_drone();
-				};
-				if (auto rc = ent.core.get_phy().raycast_nearest( conv(pos), conv(tar), {cf}, AI_Const::patrol_raycast_width ))
-				{
-					if (auto d_st = std::get_if<Idle>(&rc->ent->ref_ai_drone().get_state()))
-					if (auto os = std::get_if<IdlePatrol>(&d_st->ist);
-						os && os->pts[os->at].equals( npt, GameConst::cell_size ))
-					{
-						stop = true;
-					}
-				}
-			}
+			if (!stop) stop = is_patrol_crowded(pos, npt);
 			
 			if (stop) mov->set_target({});
 			else if (mov->set_target( npt, AI_Speed::Slow ))
 			{
-				if (st->tmo < AI_Const::patrol_point_wait) st->tmo += GameCore::step_len;
+				if (st->tmo < AI_Const::patrol_point_wait) st->tmo += passed;
 				else st->next();
 			}
 		}
@@ -615,15 +641,188 @@ void AI_Drone::step()
 			}
 		}
 	}
+}
+void AI_Drone::decide(PathSearch& aps)
+{
+	planned_ray.reset();
+	if (!mov) return;
+	mov->planned.reset();
 	
-	// rotate
+	is_deciding = true;
+	try {
+		decide_queries(aps);
+	}
+	catch (std::exception&) {
+		// think() will do same queries and report the error
+		planned_ray.reset();
+		mov->planned.reset();
+	}
+	is_deciding = false;
+}
+void AI_Drone::decide_queries(PathSearch& aps)
+{
+	// Mirrors movement part of think(), using state before it's changed. 
+	// If prediction is wrong, think() just performs queries itself
 	
-	rot_ctl.update(*this, rot_target, mov ? mov->get_next_point() : std::optional<vec2fp>{});
+	const TimeSpan passed = think_passed + GameCore::step_len; // think() is called after increment
+	const auto tar = prov.get_target();
 	
-	auto& body = ent.ref_phobj().body;
-	float nextAngle = body.GetAngle() + body.GetAngularVelocity() * GameCore::time_mul;
-	float tar_torq = angle_delta(*ent.ref_pc().rot_override, nextAngle);
-	body.ApplyAngularImpulse( body.GetInertia() * tar_torq / GameCore::time_mul, true );
+	auto move = [&](vec2fp p, AI_Speed spd, std::optional<PathRequest::Evade> evade = {}, bool unlimited_path = false) {
+		mov->planned = mov->plan_target(p, spd, evade, unlimited_path, aps);
+	};
+	
+	if (auto st = std::get_if<Battle>(&get_state()))
+	{
+		auto t_ent = ent.core.get_ent( st->grp->tar_eid );
+		if (!t_ent) return;
+		const vec2fp t_pos = t_ent->get_pos();
+		
+		if (tar)
+		{
+			// group position is updated before going to placement
+			if (st->placement) move(*st->placement, AI_Speed::Normal, placement_evade(t_pos));
+			else if (tar->dist < pars->dist_minimal)
+				move(retreat_target(t_pos, tar->dist), tar->dist >= pars->dist_panic ? AI_Speed::Slow : AI_Speed::Accel);
+			else if (tar->dist > pars->dist_optimal)
+				move(approach_target(t_pos, tar->dist), AI_Speed::Accel);
+		}
+		else
+		{
+			const vec2fp last = st->grp->get_last_pos();
+			const TimeSpan not_visible = st->not_visible + passed;
+			
+			if (st->placement) move(*st->placement, AI_Speed::Normal, placement_evade(last));
+			else if (st->chase_wait > 0 || is_camper()) {}
+			else if (not_visible > st->grp->passed_since_seen()) move(last, AI_Speed::Accel);
+			else if (!mov->has_target() || not_visible <= passed) move(chase_ahead_target(last), AI_Speed::Accel);
+		}
+	}
+	else if (auto st = std::get_if<Suspect>(&get_state()))
+	{
+		if (tar)
+		{
+			// damage raises level or starts battle
+			if (tar->is_damaging || is_camper() || tar->dist < pars->dist_optimal) return;
+			
+			float level = st->level + passed / (tar->dist < pars->dist_visible ? AI_Const::suspect_incr_close : AI_Const::suspect_incr);
+			if (level > 1 || level < AI_Const::suspect_chase_thr) return;
+			
+			if (auto t_ent = ent.core.get_ent( tar->eid ))
+				move(t_ent->get_pos(), AI_Speed::Normal);
+		}
+		else if (st->prio != Suspect::PRIO_NORMAL)
+			move(st->pos, st->prio == Suspect::PRIO_HELPCALL_HIGH ? AI_Speed::Accel : AI_Speed::Normal);
+	}
+	else if (auto st = std::get_if<Puppet>(&get_state()))
+	{
+		if (st->mov_tar) move(st->mov_tar->first, st->mov_tar->second);
+	}
+	else if (tar) {} // idle and search states are changed to suspect
+	else if (auto st = std::get_if<Search>(&get_state()))
+	{
+		if (!st->tmo.is_positive() && st->at < st->pts.size())
+			move(st->pts[st->at], AI_Speed::Patrol);
+	}
+	else
+	{
+		auto& gst = std::get<Idle>(get_state());
+		
+		if (std::holds_alternative<IdlePoint>(gst.ist))
+		{
+			move(home_point, AI_Speed::Patrol);
+		}
+		else if (auto st = std::get_if<IdlePatrol>(&gst.ist))
+		{
+			const vec2fp pos = ent.get_pos();
+			const vec2fp npt = st->pts[st->at];
+			
+			if (!st->reg) {
+				auto rm = ent.core.get_lc().get_room(pos);
+				if (rm && rm->ai_patrolling >= (int) st->pts.size()) return;
+			}
+			if (!is_patrol_crowded(pos, npt))
+				move(npt, AI_Speed::Slow);
+		}
+		else if (auto st = std::get_if<IdleChasePlayer>(&gst.ist))
+		{
+			if (!st->has_failed && !mov->has_failed() && st->pos)
+				move(*st->pos, AI_Speed::Patrol, {}, true);
+		}
+	}
+}
+std::optional<AI_Drone::RayHit> AI_Drone::raycast(RayKind kind, vec2fp from, vec2fp to)
+{
+	auto eq = [](vec2fp a, vec2fp b) {return a.x == b.x && a.y == b.y;};
+	if (!is_deciding && planned_ray && planned_ray->kind == kind && eq(planned_ray->from, from) && eq(planned_ray->to, to))
+		return planned_ray->hit;
+	
+	auto query = [&]() -> std::optional<RayHit>
+	{
+		auto& phy = ent.core.get_phy();
+		std::optional<PhysicsWorld::RaycastResult> rc;
+		
+		if (kind == RAY_PATROL) {
+			auto cf = [](Entity& ent, auto&) {
+				return !!ent.get_ai_drone();
+			};
+			rc = phy.raycast_nearest( conv(from), conv(to), {cf}, AI_Const::patrol_raycast_width );
+		}
+		else rc = phy.raycast_nearest( conv(from), conv(to) );
+		
+		if (!rc) return {};
+		return RayHit{ rc->ent, conv(rc->poi) };
+	};
+	
+	if (is_deciding) {
+		auto hit = query();
+		planned_ray = RayPlan{ kind, from, to, hit };
+		return hit;
+	}
+	return ent.core.get_aic().stats.measure(AI_Stats::C_OP_RAYCAST, query);
+}
+vec2fp AI_Drone::retreat_target(vec2fp t_pos, float tar_dist)
+{
+	const vec2fp delta = t_pos - ent.get_pos();
+	const float da = delta.angle();
+	
+	vec2fp tar = t_pos + (delta / tar_dist) * -pars->dist_minimal;
+	if (auto rc = raycast(RAY_DEFAULT, ent.get_pos(), tar)) tar = rc->poi;
+	
+	tar -= vec2fp( ent.ref_pc().get_radius() + 0.1, 0 ).rotate( da );
+	return tar;
+}
+vec2fp AI_Drone::approach_target(vec2fp t_pos, float tar_dist) const
+{
+	const vec2fp delta = t_pos - ent.get_pos();
+	const float da = delta.angle();
+	
+	vec2fp tar = ent.get_pos() + (delta / tar_dist) * pars->dist_optimal;
+	tar += vec2fp( ent.ref_pc().get_radius(), 0 ).rotate( da );
+	return tar;
+}
+vec2fp AI_Drone::chase_ahead_target(vec2fp tar)
+{
+	vec2fp dir = tar - ent.get_pos();
+	if (dir.len_squ() > 1)
+	{
+		dir.norm_to( AI_Const::chase_ahead_dist );
+		if (auto rc = raycast(RAY_DEFAULT, tar, tar + dir)) dir = rc->poi - tar;
+	}
+	return tar + dir;
+}
+bool AI_Drone::is_patrol_crowded(vec2fp pos, vec2fp npt)
+{
+	const vec2fp tar = pos + AI_Const::patrol_raycast_length * (npt - pos).norm();
+	if (auto rc = raycast(RAY_PATROL, pos, tar))
+	{
+		if (auto d_st = std::get_if<Idle>(&rc->ent->ref_ai_drone().get_state()))
+		if (auto os = std::get_if<IdlePatrol>(&d_st->ist);
+			os && os->pts[os->at].equals( npt, GameConst::cell_size ))
+		{
+			return true;
+		}
+	}
+	return false;
 }
 void AI_Drone::text_alert(std::string s, bool important, size_t /*num*/)
 {
@@ -3,6 +3,7 @@
 
 #include "client/ec_render.hpp"
 #include "client/sounds.hpp"
+#include "utils/noise.hpp"
 #include "ai_components.hpp"
 #include "ai_control.hpp"
 #include "ai_sim.hpp"
@@ -104,6 +105,14 @@ public:
 	bool always_online = false;
 	bool ignore_battle = false;
 	
+	bool think_sched = false; ///< Set by AI_Controller if delayed update is allowed on next step
+	TimeSpan think_passed; ///< Time since last update
+	size_t room_index = size_t_inval; ///< Set by AI_Controller - nearest room
+	
+	/// Drone's own random stream, seeded from core on creation. 
+	/// Used in updates so results don't depend on update order
+	RandomGen rnd;
+	
 	
 	
 	AI_Drone(Entity& ent, std::shared_ptr<AI_DroneParams> pars, IdleState idle, std::unique_ptr<AI_AttackPattern> atkpat);
@@ -127,9 +136,37 @@ public:
 	void set_idle_state(); ///< Removes all states except idle
 	
 	AI_RotationControl& get_rot_ctl() {return rot_ctl;}
+	AI_TargetProvider& get_prov() {return prov;}
 	IdleChasePlayer* as_scanner() {return std::get_if<IdleChasePlayer>(&std::get<Idle>(state_stack[0]).ist);}
 	
+	/// Returns true if drone must be updated on each step (otherwise it's updated only if scheduled)
+	bool is_think_urgent() const;
+	
+	/// Performs world queries (raycasts and path search) expected in update on this step, 
+	/// without changing anything except own query results. Called by AI_Controller for all 
+	/// updated drones before any of them is stepped, possibly on worker threads - so update 
+	/// sees world as it was before that step regardless of drone order and thread count
+	void decide(PathSearch& aps);
+	
 private:
+	enum RayKind
+	{
+		RAY_DEFAULT,
+		RAY_PATROL ///< Hits only drones, wide
+	};
+	struct RayHit
+	{
+		Entity* ent;
+		vec2fp poi; ///< Point of impact
+	};
+	struct RayPlan
+	{
+		RayKind kind;
+		vec2fp from, to;
+		std::optional<RayHit> hit;
+	};
+	
+
 	std::shared_ptr<AI_DroneParams> pars;
 	vec2fp home_point; // original spawn
 	std::vector<State> state_stack; // never empty
@@ -144,12 +181,28 @@ private:
 	TimeSpan text_alert_last; // GameCore time
 	std::unique_ptr<EC_ParticleEmitter::Channel> particles;
 	
+	std::optional<vec2fp> rot_target; // set to what should be facing now
+	
+	std::optional<RayPlan> planned_ray; // result from decide()
+	bool is_deciding = false; // set only inside decide()
+	
 	
 	void state_on_enter(State& state);
 	void state_on_leave(State& state);
 	void helpcall(std::optional<vec2fp> target, bool high_prio);
 	
 	void step() override;
+	void think(TimeSpan passed); ///< Updates state; called less often than step()
+	void decide_queries(PathSearch& aps);
+	
+	/// Inside decide() performs raycast and saves result, otherwise returns saved one if it's for same ray
+	std::optional<RayHit> raycast(RayKind kind, vec2fp from, vec2fp to);
+	
+	// movement targets, shared by think() and decide()
+	vec2fp retreat_target(vec2fp t_pos, float tar_dist);
+	vec2fp approach_target(vec2fp t_pos, float tar_dist) const;
+	vec2fp chase_ahead_target(vec2fp tar);
+	bool is_patrol_crowded(vec2fp pos, vec2fp npt);
 	void text_alert(std::string s, bool important = false, size_t num = 1);
 };
 
@@ -1,14 +1,17 @@
 #include <atomic>
+#include <condition_variable>
 #include <thread>
 #include "client/presenter.hpp"
 #include "client/replay.hpp"
 #include "client/sounds.hpp"
+#include "core/bench.hpp"
 #include "game/game_core.hpp"
 #include "game/game_mode.hpp"
 #include "game/level_ctr.hpp"
 #include "game/level_gen.hpp"
 #include "game/player_mgr.hpp"
 #include "vaslib/vas_log.hpp"
+#include "vaslib/vas_misc.hpp"
 #include "game_control.hpp"
 
 
@@ -37,8 +40,24 @@ public:
 	// thread sync
 	std::thread thr;
 	std::atomic<bool> thr_term = false;
+	std::atomic<bool> core_ready = false; // init finished
 	std::mutex ren_lock;
 	
+	struct WaitStat {
+		TimeSpan total, max;
+		size_t n = 0;
+		
+		void add(TimeSpan t) {
+			total += t;
+			max = std::max(max, t);
+			++n;
+		}
+		TimeSpan avg() const {
+			return n ? TimeSpan::micro(total.micro() / n) : TimeSpan{};
+		}
+	};
+	WaitStat wait_sim, wait_ren; // protected by ren_lock
+	
 	// game control
 	std::atomic<bool> pause_on = true;
 	int pause_steps = 0;
@@ -46,6 +65,13 @@ public:
 	std::mutex post_step_lock;
 	PostStep post_step;
 	
+	// lockstep
+	bool lockstep;
+	std::mutex ls_lock;
+	std::condition_variable ls_cv;
+	int ls_steps = 0; // requested
+	bool ls_ended = false; // thread finished
+	
 	std::mutex state_lock;
 	CoreState cur_state;
 	
@@ -69,18 +95,25 @@ public:
 		replay_rd = std::move(pars->replay_rd);
 		replay_wr = std::move(pars->replay_wr);
 		replay_rd_loadgame = pars->is_loadgame;
+		lockstep = pars->lockstep;
 		
 		thr = std::thread([this](auto pars){
 			set_this_thread_name("game step");
 			try {
 				init(std::move(pars));
+				core_ready = true;
 				VLOGI("Game initialized");
+				set_state(CS_Run{pause_on}); // lockstep waits for it before first step
 				thr_func();
 			}
 			catch (std::exception& e) {
-				set_state(CS_End{e.what(), {}});
+				set_state(CS_End{e.what(), {}, true});
 				thr_term = true;
 			}
+			
+			std::unique_lock lock(ls_lock);
+			ls_ended = true;
+			ls_cv.notify_all();
 		}, std::move(pars));
 	}
 	~GameControl_Impl()
@@ -89,8 +122,15 @@ public:
 			p->geom_static_clear();
 		
 		thr_term = true;
+		{	std::unique_lock lock(ls_lock); // wakes lockstep wait
+			ls_cv.notify_all();
+		}
 		if (thr.joinable())
 			thr.join();
+		
+		VLOGI("GameControl:: core lock wait - simulation avg {:.3f} max {:.3f} ms, render avg {:.3f} max {:.3f} ms",
+		      wait_sim.avg().seconds() * 1000, wait_sim.max.seconds() * 1000,
+		      wait_ren.avg().seconds() * 1000, wait_ren.max.seconds() * 1000);
 	}
 	void init(std::unique_ptr<InitParams> p_pars)
 	{
@@ -109,6 +149,7 @@ public:
 		core->spawn_drop = !pars.disable_drop;
 		core->spawn_hunters = !pars.disable_hunters;
 		core->get_random() = std::move(pars.rndg);
+		core->seed = fast_hash32(core->get_random().save());
 		
 		if (pars.init_presenter)
 			pres.reset(GamePresenter::init({ core.get(), terrain.get() }));
@@ -220,6 +261,12 @@ public:
 	{
 		while (!thr_term)
 		{
+			if (lockstep) {
+				std::unique_lock lock(ls_lock);
+				ls_cv.wait(lock, [&]{ return ls_steps || thr_term; });
+				if (thr_term) break;
+			}
+			
 			auto t0 = TimeSpan::current();
 			std::optional<float> sleep_time_k;
 			
@@ -230,7 +277,9 @@ public:
 			}
 			else
 			{
+				auto t_wait = TimeSpan::current();
 				std::unique_lock lock(ren_lock);
+				wait_sim.add(TimeSpan::current() - t_wait);
 				auto ctr_lock = pc_ctr.lock();
 				
 				if (!replay_rd) pc_ctr.update(PlayerInput::CTX_GAME);
@@ -253,6 +302,7 @@ public:
 					else if (std::holds_alternative<ReplayReader::RET_END>(ret))
 					{
 						VLOGW("DEMO PLAYBACK FINISHED");
+						log_checksum();
 						set_state(CS_End{"Playback finished", {}});
 						return;
 					}
@@ -277,6 +327,7 @@ public:
 			
 			if (auto mode_state = core->get_gmc().get_final_state())
 			{
+				log_checksum();
 				set_state(CS_End{{}, *mode_state});
 				break;
 			}
@@ -288,12 +339,37 @@ public:
 				if (post_step) post_step(dt);
 			}
 			
+			if (lockstep) {
+				std::unique_lock lock(ls_lock);
+				--ls_steps;
+				ls_cv.notify_all();
+				continue;
+			}
+			
 			TimeSpan t_sleep = core->step_len;
 			if (sleep_time_k) t_sleep *= *sleep_time_k;
 			sleep(t_sleep - dt); // precise_sleep causes more stutter on Linux
 		}
 		
 	}
+	/// Logs hash of world state, for comparing runs of same replay (e.g. with different ai_threads)
+	void log_checksum()
+	{
+		uint32_t h = fast_hash32(core->get_random().save());
+		auto mix = [&](const void* p, size_t n) {
+			h ^= fast_hash32(p, n);
+			h *= 16777619;
+		};
+		core->foreach([&](Entity& ent) {
+			uint32_t i = ent.index.to_int();
+			vec2fp pos = ent.get_pos();
+			mix(&i, sizeof(i));
+			mix(&pos.x, sizeof(pos.x));
+			mix(&pos.y, sizeof(pos.y));
+		});
+		VLOGI("GameControl:: world checksum at step {} - {:08x}", core->get_step_counter(), h);
+		if (auto p = RenderBench::get()) p->checksum = h;
+	}
 	void set_state(CoreState state) {
 		std::unique_lock lock(state_lock);
 		cur_state = std::move(state);
@@ -313,11 +389,20 @@ public:
 		return terrain.get();
 	}
 	std::unique_lock<std::mutex> core_lock() {
-		return std::unique_lock(ren_lock);
+		auto t_wait = TimeSpan::current();
+		std::unique_lock lock(ren_lock);
+		wait_ren.add(TimeSpan::current() - t_wait);
+		return lock;
 	}
 	GameCore& get_core() {
 		return *core;
 	}
+	bool has_core() {
+		return core_ready;
+	}
+	LockWait get_lock_wait() {
+		return {wait_sim.avg(), wait_sim.max, wait_ren.avg(), wait_ren.max};
+	}
 	void set_pause(bool on) {
 		pause_on = on;
 	}
@@ -328,6 +413,13 @@ public:
 		pause_on = false;
 		pause_steps = steps;
 	}
+	void step_lockstep() {
+		if (!lockstep) throw std::logic_error("GameControl::step_lockstep() not enabled");
+		std::unique_lock lock(ls_lock);
+		++ls_steps;
+		ls_cv.notify_all();
+		ls_cv.wait(lock, [&]{ return !ls_steps || ls_ended; });
+	}
 	ReplayReader* get_replay_reader() {
 		if (replay_rd_loadgame) return nullptr;
 		return replay_rd.get();
@@ -31,6 +31,7 @@ public:
 		TimeSpan fastforward_time = TimeSpan::seconds(10); // total
 		TimeSpan fastforward_fullworld = TimeSpan::seconds(5); // how long full world is simulated
 		bool init_presenter = true;
+		bool lockstep = false; ///< If true, steps only by step_lockstep() calls, without any delay
 		
 		// Note: init data must be already written/read
 		std::unique_ptr<ReplayReader> replay_rd;
@@ -63,6 +64,7 @@ public:
 	struct CS_End {
 		std::string err_msg; ///< Exception description, if not empty
 		GameModeCtr::FinalState fs;
+		bool is_exception = false; ///< Ended by exception (including init failure), not by game or playback
 	};
 	
 	using CoreState = std::variant<CS_Init, CS_Run, CS_End>;
@@ -83,10 +85,24 @@ public:
 	
 	virtual GameCore& get_core() = 0;
 	
+	/// Returns true if init finished and get_core() can be used (even after CS_End). Doesn't require lock
+	virtual bool has_core() = 0;
+	
+	/// Time spent waiting for core lock, since start
+	struct LockWait {
+		TimeSpan sim_avg, sim_max; ///< By simulation thread, per step
+		TimeSpan ren_avg, ren_max; ///< By core_lock() callers
+	};
+	virtual LockWait get_lock_wait() = 0;
+	
 	virtual void set_pause(bool on) = 0;
 	virtual void set_speed(std::optional<float> k) = 0; ///< Multiplies sleep time
 	virtual void step_paused(int steps) = 0; ///< Allows that many steps before pausing
 	
+	/// Performs single step (unless paused) and waits for it to finish. 
+	/// Core lock must NOT be held. Only if initialized with lockstep
+	virtual void step_lockstep() = 0;
+	
 	virtual ReplayReader* get_replay_reader() = 0;
 	virtual ReplayWriter* get_replay_writer() = 0;
 };
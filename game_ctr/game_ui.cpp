@@ -1,3 +1,4 @@
+#include <cstring>
 #include <SDL2/SDL_events.h>
 #include "game_ui.hpp"
 
@@ -208,6 +209,8 @@ public:
 	// debug stats
 	
 	RAII_Guard dbg_serv_g;
+	RAII_Guard dbg_ai_g;
+	size_t dbg_ai_sort = 0; ///< AI stats table column
 	std::optional<vigAverage> dbg_serv_avg;
 	
 	double serv_avg_total = 0;
@@ -245,6 +248,11 @@ public:
 				dbg_serv_avg->draw();
 				vig_lo_next();
 				
+				auto lw = gctr.get_lock_wait();
+				vig_label_a("Core lock wait (ms): step {:.3f} avg, {:.3f} max; render {:.3f} avg, {:.3f} max\n",
+				            lw.sim_avg.seconds() * 1000, lw.sim_max.seconds() * 1000,
+				            lw.ren_avg.seconds() * 1000, lw.ren_max.seconds() * 1000);
+				
 				if (vig_button("Save world render")) {
 					lock.unlock();
 					save_automap("AUTOMAP.png");
@@ -259,8 +267,11 @@ public:
 				vig_lo_next();
 				
 				vig_label_a("Raycasts:  {:4}\nAABB query: {:3}\n",
-				            core.get_phy().raycast_count, core.get_phy().aabb_query_count);
-				vig_label_a("Bots (battle): {}\n", core.get_aic().debug_batle_number);
+				            core.get_phy().raycast_count.load(), core.get_phy().aabb_query_count);
+				vig_label_a("Bots (battle): {}\nAI updates: {}\nAI LoS: {} ({} cached)\nSearch rings: {} ({} reused)\n",
+				            core.get_aic().debug_batle_number, core.get_aic().debug_think_number,
+				            core.get_aic().debug_los_number, core.get_aic().debug_los_cached,
+				            core.get_aic().debug_rings_calc, core.get_aic().debug_rings_reused);
 				vig_lo_next();
 				
 				//
@@ -297,6 +308,7 @@ public:
 				{
 					vig_checkbox(core.dbg_ai_attack, "AI attack");
 					vig_checkbox(core.dbg_ai_see_plr, "AI see player");
+					vig_slider("AI update budget", core.get_aic().think_budget, 1, 100);
 					vig_lo_next();
 				}
 				if (auto ent = core.get_pmg().get_ent())
@@ -349,6 +361,53 @@ public:
 					vig_lo_next();
 				}
 			});
+			
+			dbg_ai_g = vig_reg_menu(VigMenu::DebugAI, [this]
+			{
+				auto lock = gctr.core_lock();
+				auto& st = gctr.get_core().get_aic().stats;
+				
+				const char* cols[] = {"Name", "Step us", "Step N", "Avg us", "Avg N"};
+				for (size_t i=0; i < std::size(cols); ++i) {
+					if (vig_button(cols[i], 0, dbg_ai_sort == i))
+						dbg_ai_sort = i;
+				}
+				vig_lo_next();
+				
+				const double k = st.total_steps ? 1. / st.total_steps : 0;
+				auto value = [&](size_t c, size_t col) -> double {
+					switch (col) {
+					case 1: return st.last[c].time.micro();
+					case 2: return st.last[c].count;
+					case 3: return st.total[c].time.micro() * k;
+					case 4: return st.total[c].count * k;
+					}
+					return 0;
+				};
+				
+				std::array<size_t, AI_Stats::C_TOTAL_COUNT> rows;
+				for (size_t i=0; i < rows.size(); ++i) rows[i] = i;
+				auto name = [](size_t c) {return AI_Stats::get_name(static_cast<AI_Stats::Category>(c));};
+				std::stable_sort(rows.begin(), rows.end(), [&](size_t a, size_t b) {
+					if (!dbg_ai_sort) return std::strcmp(name(a), name(b)) < 0;
+					return value(a, dbg_ai_sort) > value(b, dbg_ai_sort);
+				});
+				
+				std::string s;
+				for (size_t c : rows) {
+					s += FMT_FORMAT("{:<13} {:7.0f} {:6.0f} {:7.1f} {:6.2f}\n", name(c),
+					                value(c, 1), value(c, 2), value(c, 3), value(c, 4));
+				}
+				s.pop_back();
+				vig_label(s);
+				vig_lo_next();
+				
+				vig_label_a("Steps: {}", st.total_steps);
+				if (vig_button("Write CSV")) {
+					st.write_csv(HARDPATH_AI_STATS_CSV);
+					vig_message("Written to " HARDPATH_AI_STATS_CSV);
+				}
+			});
 		}
 	}
 	~GameUI_Impl()
@@ -731,8 +790,8 @@ public:
 				
 				vec2fp pos;
 				if (auto ent = core.get_pmg().get_ent()) {
-					if (GamePresenter::get()->playback_hack) pos = ent->get_pos();
-					else pos = ent->ref<EC_RenderPos>().get_cur().pos;
+					if (auto p = GamePresenter::get()->get_render_pos(ent->index)) pos = *p;
+					else pos = ent->get_pos();
 				}
 				else pos = core.get_pmg().get_last_pos();
 				
@@ -755,10 +814,12 @@ public:
 				cctr.update(tar, passed);
 			}
 			
-			// draw world
+			// draw world - presenter uses only state copied on sync
 			
+			lock.unlock();
 			RenImm::get().set_context(RenImm::DEFCTX_WORLD);
 			GamePresenter::get()->render( frame_time, passed );
+			lock = gctr.core_lock();
 			
 			if (ph_debug_draw)
 				core.get_phy().world.DebugDraw();
@@ -1240,6 +1301,7 @@ public:
 				}
 			}
 		}
+		GamePresenter::get()->publish_vport();
 		GamePresenter::get()->sync( TimeSpan::current() );
 		
 		frm.mag = 8;
@@ -1,14 +1,16 @@
-#include <condition_variable>
+#include <deque>
 #include <mutex>
 #include <thread>
 #include <SDL2/SDL.h>
 #include "core/settings.hpp"
+#include "core/vig.hpp"
 #include "utils/res_image.hpp"
 #include "vaslib/vas_log.hpp"
 #include "camera.hpp"
 #include "control.hpp"
 #include "gl_utils.hpp"
 #include "postproc.hpp"
+#include "pp_graph.hpp"
 #include "ren_text.hpp"
 #include "shader.hpp"
 
@@ -16,6 +18,7 @@ class RenderControl_Impl;
 static RenderControl_Impl* rct;
 
 bool RenderControl::opt_gldbg = false;
+bool RenderControl::opt_headless = false;
 
 
 
@@ -76,11 +79,27 @@ public:
 	
 	std::vector< std::function<void()> > cb_resize;
 	vec2i old_size;
+	
+	// dynamic resolution
+	static constexpr float ofs_step = 0.1; ///< Scale change per adjustment
+	static constexpr float ofs_high = 0.9; ///< Part of frame budget above which scale is decreased
+	static constexpr float ofs_low  = 0.7; ///< Predicted part of frame budget below which scale is increased
+	static constexpr float ofs_avg_k = 0.1; ///< Frame time averaging factor
+	static constexpr TimeSpan ofs_cooldown = TimeSpan::seconds(1.5); ///< Lets averaged timers settle after change
+	
+	std::vector< std::function<void()> > cb_offscreen;
+	float ofs_scale = 1;
+	vec2i ofs_size;
+	TimeSpan ofs_wait; // until next adjustment
+	float ofs_frame = 0; // averaged frame time, milliseconds
 
 	FullscreenValue fs_cur = FULLSCREEN_OFF;
 	vec2i nonfs_size; // windowed size
 	
 	TimeSpan last_passed = TimeSpan::fps(30);
+	TimeSpan last_swap;
+	
+	RAII_Guard dbg_g;
 	
 	
 	
@@ -88,6 +107,12 @@ public:
 	{
 		mainthr_id = std::this_thread::get_id();
 		
+		if (opt_headless) {
+			// EGL pbuffer surface - works without display server or GPU (Mesa llvmpipe)
+			SDL_setenv("SDL_VIDEODRIVER", "offscreen", 1);
+			VLOGW("RenderControl:: Using offscreen video driver");
+		}
+		
 		if (SDL_InitSubSystem(SDL_INIT_VIDEO))
 		{
 			VLOGE("SDL_InitSubSystem failed - {}", SDL_GetError());
@@ -109,6 +134,7 @@ public:
 		
 		auto wnd_sz = AppSettings::get().wnd_size;
 		auto opt_fs = AppSettings::get().fscreen;
+		if (opt_headless) opt_fs = AppSettings::FS_Windowed;
 		nonfs_size = wnd_sz;
 		if (opt_fs == AppSettings::FS_Fullscreen)
 		{
@@ -120,7 +146,7 @@ public:
 		}
 		old_size = wnd_sz;
 		
-		int wnd_flags = SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE;
+		int wnd_flags = SDL_WINDOW_OPENGL | (opt_headless ? SDL_WINDOW_HIDDEN : SDL_WINDOW_RESIZABLE);
 		if (opt_fs == AppSettings::FS_Fullscreen) wnd_flags |= SDL_WINDOW_FULLSCREEN;
 		else if (opt_fs == AppSettings::FS_Borderless) wnd_flags |= SDL_WINDOW_FULLSCREEN_DESKTOP;
 		else if (opt_fs == AppSettings::FS_Maximized) wnd_flags |= SDL_WINDOW_MAXIMIZED;
@@ -213,6 +239,14 @@ public:
 		
 		rct = this; // may be needed in these classes
 		
+		ofs_scale = std::max(AppSettings::get().dyn_res_min, AppSettings::get().dyn_res_max);
+		ofs_size = calc_offscreen_size(ofs_scale);
+		
+		dbg_g = vig_reg_menu(VigMenu::DebugRenderer, [this]{
+			vig_label_a("Render tasks: {:3} queued, {:3} done in {:.3f} ms, max wait {:.3f} ms\n",
+			            dbg_task_depth, dbg_task_done, dbg_task_time.seconds() * 1000, dbg_task_wait.seconds() * 1000);
+		});
+		
 		try {
 			r_text = RenText::init();
 			pp_main = Postproc::init();
@@ -227,6 +261,11 @@ public:
 	}
 	~RenderControl_Impl()
 	{
+		{	std::unique_lock lock(task_m);
+			tasks_interrupted = true;
+			tasks.clear(); // breaks promises
+		}
+		
 		delete pp_main;
 		delete r_text;
 		delete ndc_screen2_obj;
@@ -235,9 +274,6 @@ public:
 		SDL_DestroyWindow( wnd );
 		if (wnd) SDL_QuitSubSystem( SDL_INIT_VIDEO );
 		
-		tasks_interrupted = true;
-		task_cv.notify_all();
-		
 		rct = nullptr;
 	}
 	
@@ -247,6 +283,7 @@ public:
 	bool    is_visible()       { return visib; }
 	SDL_Window* get_wnd()      { return wnd; }
 	TimeSpan    get_passed()   { return last_passed; }
+	TimeSpan    get_swap_time(){ return last_swap; }
 	
 	vec2i get_current_cursor()
 	{
@@ -281,6 +318,8 @@ public:
 			return true;
 		}
 		
+		update_offscreen(passed);
+		
 		glBindFramebuffer(GL_FRAMEBUFFER, 0);
 		glViewport(0, 0, n_size.x, n_size.y);
 		
@@ -328,12 +367,17 @@ public:
 			}
 		}
 		
+		GLA_StreamBuffer::next_frame();
+		
+		auto t0 = TimeSpan::current();
+		if (opt_headless) glFinish();
 		SDL_GL_SwapWindow(wnd);
+		last_swap = TimeSpan::current() - t0;
 		return true;
 	}
 	void on_event( SDL_Event& ev )
 	{
-		if (ev.type == SDL_WINDOWEVENT)
+		if (ev.type == SDL_WINDOWEVENT && !opt_headless)
 		{
 //			if (ev.window.windowID != SDL_GetWindowID(wnd)) return;
 			
@@ -427,54 +471,166 @@ public:
 			static_cast<RenderControl_Impl*>(rct)->cb_resize[i] = {};
 		});
 	}
+	float get_offscreen_scale()
+	{
+		return ofs_scale;
+	}
+	vec2i get_offscreen_size()
+	{
+		return ofs_size;
+	}
+	RAII_Guard add_offscreen_cb(std::function<void()> cb, bool call_now)
+	{
+		if (call_now) cb();
+		
+		size_t i=0;
+		for (; i<cb_offscreen.size(); ++i) if (!cb_offscreen[i]) break;
+		if (i == cb_offscreen.size()) cb_offscreen.emplace_back();
+		
+		cb_offscreen[i] = std::move(cb);
+		return RAII_Guard([i](){
+			if (!rct) return;
+			static_cast<RenderControl_Impl*>(rct)->cb_offscreen[i] = {};
+		});
+	}
+	vec2i calc_offscreen_size(float scale)
+	{
+		vec2i sz = (vec2fp(get_size()) * scale).int_round();
+		return {std::max(sz.x, 1), std::max(sz.y, 1)};
+	}
+	/// Adjusts offscreen scale using measured time of last frames
+	void update_offscreen(TimeSpan passed)
+	{
+		auto& sets = AppSettings::get();
+		float s_min = std::min(sets.dyn_res_min, sets.dyn_res_max);
+		float s_max = std::max(sets.dyn_res_min, sets.dyn_res_max);
+		float scale = clampf(ofs_scale, s_min, s_max);
+		
+		if (opt_headless) scale = s_max; // reproducible benchmark results
+		
+		// postprocessing is the only part which depends on scale
+		float pp_cost = PP_Graph::get().get_frame_time();
+		
+		// with vsync swap mostly waits for vblank, but GPU still must finish postprocessing
+		float frame = frame_time.seconds() * 1000;
+		float swap = last_swap.seconds() * 1000;
+		if (has_vsync()) frame = std::max(frame - swap, pp_cost);
+		ofs_frame += (frame - ofs_frame) * ofs_avg_k;
+		
+		ofs_wait -= passed;
+		if (s_min < s_max && ofs_wait.micro() <= 0 && !opt_headless)
+		{
+			float budget = frame_budget.seconds() * 1000;
+			
+			if (ofs_frame > budget * ofs_high) {
+				scale = std::max(s_min, scale - ofs_step);
+			}
+			else if (scale < s_max) {
+				// pixel count (and so cost) is proportional to square of scale
+				float up = std::min(s_max, scale + ofs_step);
+				float scaled = std::min(pp_cost, ofs_frame);
+				if (ofs_frame + scaled * ((up * up) / (scale * scale) - 1) < budget * ofs_low) scale = up;
+			}
+		}
+		
+		vec2i sz = calc_offscreen_size(scale);
+		if (sz != ofs_size)
+		{
+			ofs_scale = scale;
+			ofs_size = sz;
+			ofs_wait = ofs_cooldown;
+			for (auto& c : cb_offscreen) if (c) c();
+		}
+		else ofs_scale = scale;
+	}
 	
 	
 	
-	std::vector<std::pair<bool, callable_ref<void()>*>> tasks;
-	std::condition_variable task_cv;
+	struct Task
+	{
+		std::function<void()> f;
+		std::promise<void> done;
+		TimeSpan posted;
+	};
+	std::deque<Task> tasks;
 	std::mutex task_m;
 	bool tasks_interrupted = false;
 	
+	size_t dbg_task_depth = 0; ///< Queue size before last execution
+	size_t dbg_task_done = 0; ///< Executed on last frame
+	TimeSpan dbg_task_wait; ///< Max time in queue of tasks executed on last frame
+	TimeSpan dbg_task_time; ///< Spent executing on last frame
+	
 	void exec_task(callable_ref<void()> f)
 	{
 		if (is_rendering_thread()) {
 			f();
 			return;
 		}
-		size_t i=0;
-		{
-			std::unique_lock lock(task_m);
-			for (; i < tasks.size(); ++i) if (!tasks[i].second) break;
-			if (i == tasks.size()) tasks.emplace_back();
-			tasks[i] = std::make_pair(false, &f);
+		auto res = post_task([&]{ f(); });
+		try {
+			res.get();
+		}
+		catch (std::future_error&) {
+			throw std::runtime_error("RenderControl::exec_task() interrupted");
+		}
+	}
+	std::future<void> post_task(std::function<void()> f)
+	{
+		std::promise<void> done;
+		auto res = done.get_future();
+		
+		if (is_rendering_thread()) {
+			run_task(f, done);
+			return res;
 		}
 		
 		std::unique_lock lock(task_m);
-		task_cv.wait(lock, [&]
-		{
-			if (tasks_interrupted) return true;
-			if (!tasks[i].first) return false;
-			
-			tasks[i].second = nullptr;
-			for (auto& t : tasks) if (t.second) return true;
-			tasks.clear();
-			return true;
-		});
-		if (tasks_interrupted)
-			throw std::runtime_error("RenderControl::exec_task() interrupted");
+		if (tasks_interrupted) throw std::runtime_error("RenderControl::post_task() interrupted");
+		tasks.push_back({ std::move(f), std::move(done), TimeSpan::current() });
+		return res;
+	}
+	static void run_task(std::function<void()>& f, std::promise<void>& done)
+	{
+		try {
+			f();
+			done.set_value();
+		}
+		catch (...) {
+			done.set_exception(std::current_exception());
+		}
 	}
 	void proc_tasks()
 	{
-		std::unique_lock lock(task_m);
-		for (auto& t : tasks)
+		auto t0 = TimeSpan::current();
+		dbg_task_done = 0;
+		dbg_task_wait = {};
+		
+		{	std::unique_lock lock(task_m);
+			dbg_task_depth = tasks.size();
+		}
+		while (true)
 		{
-			if (t.second && !t.first) {
-				(*t.second)();
-				t.first = true;
+			Task t;
+			{	std::unique_lock lock(task_m);
+				if (tasks.empty()) break;
+				t = std::move(tasks.front());
+				tasks.pop_front();
 			}
+			
+			// executed without lock, so posting threads never wait for it
+			dbg_task_wait = std::max(dbg_task_wait, TimeSpan::current() - t.posted);
+			run_task(t.f, t.done);
+			++dbg_task_done;
+			
+			if (TimeSpan::current() - t0 >= task_budget) break;
 		}
-		task_cv.notify_all();
+		
+		dbg_task_time = TimeSpan::current() - t0;
 	}
+	
+	
+	
 	bool is_rendering_thread() const
 	{
 		return mainthr_id == std::this_thread::get_id();
@@ -1,6 +1,7 @@
 #ifndef REN_CTL_HPP
 #define REN_CTL_HPP
 
+#include <future>
 #include "vaslib/vas_cpp_utils.hpp"
 #include "vaslib/vas_math.hpp"
 #include "vaslib/vas_time.hpp"
@@ -24,11 +25,18 @@ public:
 	};
 	
 	static bool opt_gldbg; // init options
+	static bool opt_headless; ///< Init option - hidden window on offscreen driver, waits for GPU each frame
 	
 	/// If set, writes screen data (RGBA, y-flipped) to it before swapping buffers. 
 	/// Reset after each render() call
 	ImageInfo* img_screenshot = nullptr;
 	
+	/// Frame time which dynamic resolution tries to fit into, set by main loop
+	TimeSpan frame_budget = TimeSpan::fps(60);
+	
+	/// Measured time of whole last frame, excluding sleep; set by main loop. Drives dynamic resolution
+	TimeSpan frame_time;
+	
 	
 	
 	static bool init(); ///< Initialize singleton (including all other rendering singletons)
@@ -47,6 +55,7 @@ public:
 	virtual SDL_Window* get_wnd() = 0;
 	
 	virtual TimeSpan get_passed() = 0; ///< Returns last 'passed' value which was passed to render()
+	virtual TimeSpan get_swap_time() = 0; ///< Returns duration of buffer swap in last render() (including GPU wait if headless)
 
 	
 	
@@ -85,10 +94,29 @@ public:
 	/// Adds callback to be called at screen size change. Returns callback deleter
 	[[nodiscard]] virtual RAII_Guard add_size_cb(std::function<void()> cb, bool call_now = true) = 0;
 	
-	/// Executes function on render thread. 
-	/// Throws if RenderControl no longer exists
+	/// Returns current scale of offscreen buffers relative to screen size (dynamic resolution)
+	virtual float get_offscreen_scale() = 0;
+	
+	/// Returns size of offscreen buffers in pixels. 
+	/// Viewport must be set to it when drawing into such buffer and restored afterwards
+	virtual vec2i get_offscreen_size() = 0;
+	
+	/// Adds callback to be called when offscreen size changes (including on screen size change). 
+	/// Called only between frames. Returns callback deleter
+	[[nodiscard]] virtual RAII_Guard add_offscreen_cb(std::function<void()> cb, bool call_now = true) = 0;
+	
+	/// Executes function on render thread and waits for it. 
+	/// Throws if RenderControl no longer exists or if function throws
 	virtual void exec_task(callable_ref<void()> f) = 0;
 	
+	/// Queues function to be executed on render thread, doesn't wait. 
+	/// Queued tasks are executed before frame, at least one and until task_budget is exceeded. 
+	/// Executed immediately if called from render thread. 
+	/// Future holds exception thrown by function or std::future_error if RenderControl is destroyed before execution
+	virtual std::future<void> post_task(std::function<void()> f) = 0;
+	
+	TimeSpan task_budget = TimeSpan::ms(4); ///< Per frame
+	
 	/// Returns true if current thread is main one
 	virtual bool is_rendering_thread() const = 0;
 };
@@ -1,3 +1,4 @@
+#include <cstring>
 #include "vaslib/vas_log.hpp"
 #include "gl_utils.hpp"
 #include "texture.hpp"
@@ -104,6 +105,115 @@ size_t GLA_Buffer::size_bytes() const
 
 
 
+size_t GLA_StreamBuffer::dbg_upload_bytes;
+size_t GLA_StreamBuffer::dbg_stalls;
+size_t GLA_StreamBuffer::frame_cur = 1;
+size_t GLA_StreamBuffer::dbg_bytes_cur;
+size_t GLA_StreamBuffer::dbg_stalls_cur;
+
+GLA_StreamBuffer::GLA_StreamBuffer(int comp, int stride, int type, bool normalized)
+{
+	buf = std::make_shared<GLA_Buffer>(comp, type, normalized, GL_STREAM_DRAW);
+	stride_bytes = stride * gl_type_size(type);
+}
+GLA_StreamBuffer::~GLA_StreamBuffer()
+{
+	if (glDeleteSync) {
+		for (auto& f : fences) glDeleteSync(f);
+	}
+}
+size_t GLA_StreamBuffer::upload( size_t val_count, const void* data )
+{
+	size_t bytes = val_count * gl_type_size(buf->type);
+	
+	if (frame_last != frame_cur)
+	{
+		// previous frame commands are already issued
+		if (frame_last && glFenceSync) {
+			if (fences[seg_i]) glDeleteSync(fences[seg_i]);
+			fences[seg_i] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		}
+		
+		frame_last = frame_cur;
+		seg_i = (seg_i + 1) % seg_count;
+		seg_used = 0;
+		
+		if (seg_size >= bytes) wait_segment();
+	}
+	
+	seg_used = (seg_used + stride_bytes - 1) / stride_bytes * stride_bytes;
+	if (seg_used + bytes > seg_size)
+	{
+		realloc(seg_used + bytes);
+		seg_used = 0;
+	}
+	else buf->bind();
+	
+	size_t off = seg_i * seg_size + seg_used;
+	if (bytes)
+	{
+		void* p = glMapBufferRange(GL_ARRAY_BUFFER, off, bytes,
+		                           GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+		if (p) {
+			std::memcpy(p, data, bytes);
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+		}
+		else glBufferSubData(GL_ARRAY_BUFFER, off, bytes, data);
+	}
+	
+	seg_used += bytes;
+	dbg_bytes_cur += bytes;
+	return off / stride_bytes;
+}
+void GLA_StreamBuffer::next_frame()
+{
+	++frame_cur;
+	dbg_upload_bytes = dbg_bytes_cur;
+	dbg_stalls = dbg_stalls_cur;
+	dbg_bytes_cur = 0;
+	dbg_stalls_cur = 0;
+}
+void GLA_StreamBuffer::realloc(size_t min_seg_size)
+{
+	// old storage is orphaned, so fences are not needed anymore
+	if (glDeleteSync) {
+		for (auto& f : fences) {
+			glDeleteSync(f);
+			f = nullptr;
+		}
+	}
+	
+	seg_size = std::max(min_seg_size + min_seg_size / 2, seg_size * 2);
+	seg_size = (seg_size + stride_bytes - 1) / stride_bytes * stride_bytes;
+	
+	buf->update( seg_size * seg_count / gl_type_size(buf->type) );
+}
+void GLA_StreamBuffer::wait_segment()
+{
+	if (!glFenceSync) {
+		// can't check if GPU is done, so orphan storage when ring wraps around
+		if (!seg_i) buf->update( buf->val_count );
+		return;
+	}
+	
+	auto& f = fences[seg_i];
+	if (!f) return;
+	
+	if (glClientWaitSync(f, 0, 0) == GL_TIMEOUT_EXPIRED)
+	{
+		++dbg_stalls_cur;
+		while (true) {
+			auto r = glClientWaitSync(f, GL_SYNC_FLUSH_COMMANDS_BIT, 1'000'000'000);
+			if (r != GL_TIMEOUT_EXPIRED) break;
+		}
+	}
+	
+	glDeleteSync(f);
+	f = nullptr;
+}
+
+
+
 GLA_VertexArray::GLA_VertexArray()
 {
 	glGenVertexArrays( 1, &vao );
@@ -134,12 +244,12 @@ void GLA_VertexArray::bind()
 void GLA_VertexArray::set_attrib( size_t index, std::shared_ptr<GLA_Buffer> buf, size_t stride, size_t offset )
 {
 	if (!buf) return;
-	bufs.emplace_back(std::move(buf));
+	auto& b = bufs.emplace_back(std::move(buf));
 	
 	glBindVertexArray( vao );
-	buf->bind();
+	b->bind();
 	glEnableVertexAttribArray( index );
-	glVertexAttribPointer( index, buf->comp, buf->type, buf->normalized, stride, reinterpret_cast< void* >(offset) );
+	glVertexAttribPointer( index, b->comp, b->type, b->normalized, stride, reinterpret_cast< void* >(offset) );
 }
 void GLA_VertexArray::set_buffers( std::vector< std::shared_ptr<GLA_Buffer> > new_bufs )
 {
@@ -193,6 +303,7 @@ void GLA_VertexArray::set_attribs( std::vector< Attrib > attrs )
 		
 		b->bind();
 		glEnableVertexAttribArray(i);
+		glVertexAttribDivisor(i, a.divisor);
 		
 		auto& s = ss[b];
 		if (!s.cou) glVertexAttribPointer( i, a.comp, b->type, b->normalized, 0, nullptr );
@@ -59,6 +59,51 @@ struct GLA_Buffer
 
 
 
+/// Ring buffer for data which is re-uploaded each frame. 
+/// Consists of several per-frame segments; segment is reused only after GPU finished with it
+/// (checked with fences, if not available buffer is orphaned instead)
+struct GLA_StreamBuffer
+{
+	static size_t dbg_upload_bytes; ///< info: bytes uploaded during last frame
+	static size_t dbg_stalls; ///< info: waits for GPU during last frame
+	
+	std::shared_ptr<GLA_Buffer> buf; ///< Used for VAO setup
+	
+	
+	/// Stride is number of values per vertex (offsets are aligned to it)
+	GLA_StreamBuffer(int comp, int stride, int type = GL_FLOAT, bool normalized = false);
+	~GLA_StreamBuffer();
+	
+	GLA_StreamBuffer( const GLA_StreamBuffer& ) = delete;
+	void operator =( const GLA_StreamBuffer& ) = delete;
+	
+	/// Copies data into buffer, returns index of first vertex (in strides); binds buffer. 
+	/// If buffer is too small it's reallocated, which invalidates data uploaded before in same frame
+	size_t upload( size_t val_count, const void* data );
+	size_t upload( const std::vector<float>& vs ) {return upload(vs.size(), vs.data());}
+	
+	/// Must be called once per frame, after all rendering
+	static void next_frame();
+	
+private:
+	static constexpr size_t seg_count = 3;
+	static size_t frame_cur; // incremented by next_frame()
+	static size_t dbg_bytes_cur;
+	static size_t dbg_stalls_cur;
+	
+	size_t stride_bytes;
+	size_t seg_size = 0; // bytes
+	size_t seg_i = 0; // current
+	size_t seg_used = 0; // bytes
+	size_t frame_last = 0; // last frame buffer was used in
+	GLsync fences[seg_count] = {};
+	
+	void realloc(size_t min_seg_size);
+	void wait_segment();
+};
+
+
+
 /// Wrapper for vertex array object
 struct GLA_VertexArray
 {
@@ -91,6 +136,7 @@ struct GLA_VertexArray
 	{
 		std::shared_ptr<GLA_Buffer> buf;
 		int comp; ///< number of components
+		int divisor = 0; ///< Instance divisor, 0 if per-vertex
 	};
 	/// Automatically sets all attributes with calculated strides and offsets; binds both VAO and VBOs
 	void set_attribs( std::vector< Attrib> attrs );
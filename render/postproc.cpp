@@ -1,6 +1,7 @@
 #include <deque>
 #include <future>
 #include "core/settings.hpp"
+#include "core/vig.hpp"
 #include "vaslib/vas_log.hpp"
 #include "postproc.hpp"
 #include "pp_graph.hpp"
@@ -89,6 +90,22 @@ struct PPF_Tint : PP_Filter
 		return false;
 	}
 	void proc() override
+	{
+		sh->bind();
+		fused_proc(*sh);
+		draw(true);
+	}
+	std::optional<FusedStage> fused_stage() override
+	{
+		return FusedStage{"FUSE_TINT", 1};
+	}
+	void fused_proc(Shader& sh) override
+	{
+		step();
+		sh.set_clr("mul", p_mul);
+		sh.set_clr("add", p_add);
+	}
+	void step()
 	{
 		float time = get_passed().seconds();
 		while (!steps.empty())
@@ -108,11 +125,6 @@ struct PPF_Tint : PP_Filter
 			p_add = s.a1;
 			steps.pop_front();
 		}
-		
-		sh->bind();
-		sh->set_clr("mul", p_mul);
-		sh->set_clr("add", p_add);
-		draw(true);
 	}
 	void reset()
 	{
@@ -158,6 +170,16 @@ struct PPF_Shake : PP_Filter
 		return (str > 0 || str_tar > 0) && AppSettings::get().cam_pp_shake_str > 1e-5;
 	}
 	void proc() override
+	{
+		sh->bind();
+		fused_proc(*sh);
+		draw(true);
+	}
+	std::optional<FusedStage> fused_stage() override
+	{
+		return FusedStage{"FUSE_SHAKE", 0};
+	}
+	void fused_proc(Shader& sh) override
 	{
 		float ps = RenderControl::get().get_passed().seconds();
 		
@@ -179,9 +201,7 @@ struct PPF_Shake : PP_Filter
 		float x = cossin_lut(t * spd_mul.x).y * k / sz.xy_ratio();
 		float y = cossin_lut(t * spd_mul.y).y * k * 0.7;
 		
-		sh->bind();
-		sh->set2f("tmod", x, y);
-		draw(true);
+		sh.set2f("tmod", x, y);
 	}
 	void add(float power)
 	{
@@ -319,6 +339,16 @@ public:
 		sh_eff = Shader::load("pp/smoke", {});
 		sh_space_bg = Shader::load("space_bg", {});
 		
+		mask_vao.set_attribs({
+			{RenderControl::get().ndc_screen2().bufs[0], 2},
+			{inst_buf.buf, 4, 1},
+			{inst_buf.buf, 1, 1} });
+		
+		dbg_g = vig_reg_menu(VigMenu::DebugRenderer, [this]{
+			vig_label_a("Smoke: {:3} ({:3} visible), draw calls: {}, fill: {:.2f} Mpx\n",
+			            smokes.size(), dbg_visible, dbg_draw_calls, dbg_fill / 1e6);
+		});
+		
 		fbo_eff.em_texs.emplace_back();
 		fbo_mask.em_texs.emplace_back();
 		rsz_g = RenderControl::get().add_size_cb([this]
@@ -326,8 +356,10 @@ public:
 			fbo_eff.em_texs[0].set(GL_RGBA, RenderControl::get_size(), 0, 4);
 			fbo_eff.attach_tex(GL_COLOR_ATTACHMENT0, fbo_eff.em_texs[0]);
 			fbo_eff.check_throw("PP_Smoke eff");
-			
-			fbo_mask.em_texs[0].set(GL_R8, RenderControl::get_size(), 0, 1);
+		});
+		ofs_g = RenderControl::get().add_offscreen_cb([this]
+		{
+			fbo_mask.em_texs[0].set(GL_R8, RenderControl::get().get_offscreen_size(), 0, 1);
 			fbo_mask.attach_tex(GL_COLOR_ATTACHMENT0, fbo_mask.em_texs[0]);
 			fbo_mask.check_throw("PP_Smoke mask");
 		});
@@ -381,6 +413,7 @@ public:
 	}
 	void add(const Postproc::Smoke& i)
 	{
+		reserve_more_block(smokes, 64);
 		auto& s = smokes.emplace_back();
 		s.ctr = i.at;
 		s.vel = i.vel;
@@ -417,11 +450,21 @@ private:
 	GLA_Framebuffer fbo_mask, fbo_eff;
 	GLA_Texture tex_noi, tex_circ;
 	std::unique_ptr<Shader> sh_mask, sh_eff, sh_space_bg;
-	RAII_Guard rsz_g;
+	RAII_Guard rsz_g, ofs_g;
+	
+	static constexpr int inst_stride = 5; // pars (center, radius), alpha
+	GLA_VertexArray mask_vao;
+	GLA_StreamBuffer inst_buf{0, inst_stride};
+	std::vector<float> inst_data;
 	
-	std::vector<SmokeData> smokes;
+	std::vector<SmokeData> smokes; // unordered
 	float t_val = 0;
 	
+	RAII_Guard dbg_g;
+	size_t dbg_visible = 0;
+	size_t dbg_draw_calls = 0;
+	float dbg_fill = 0; // pixels
+	
 	bool prepare() override
 	{
 		if (!sh_mask->is_ok() || !sh_eff->is_ok() || smokes.empty() || !enabled)
@@ -436,29 +479,34 @@ private:
 	{
 		auto& cam = RenderControl::get().get_world_camera();
 		auto  ssz = RenderControl::get().get_size();
+		auto  msz = RenderControl::get().get_offscreen_size();
 		
 		glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
 		glBlendEquation(GL_FUNC_ADD);
 		
 		fbo_mask.bind();
+		glViewport(0, 0, msz.x, msz.y);
 		glClearColor(0, 0, 0, 0);
 		glClear(GL_COLOR_BUFFER_BIT);
 		
-		sh_mask->bind();
-		sh_mask->set4mx("proj", cam.get_full_matrix());
-		
-		glActiveTexture(GL_TEXTURE0);
-		tex_circ.bind();
-		RenderControl::get().ndc_screen2().bind();
-		
 		const float z_max_dist = ssz.minmax().y + max_dist;
 		const float time_mul = RenderControl::get().get_passed().seconds();
 		t_val += z_speed * time_mul;
 		
-		for (auto it = smokes.begin(); it != smokes.end(); )
+		vec2fp scr_hsz = cam.coord_size() / 2;
+		const vec2fp px_per_unit = vec2fp(msz) / cam.coord_size();
+		if (cam.get_state().rot) scr_hsz = vec2fp::one(scr_hsz.len());
+		const Rectfp scr = Rectfp::from_center(cam.get_state().pos, scr_hsz);
+		
+		inst_data.clear();
+		dbg_fill = 0;
+		
+		for (size_t i=0; i < smokes.size(); )
 		{
-			auto& s = *it;
+			auto& s = smokes[i];
 			s.ctr += s.vel * time_mul;
+			
+			bool alive = true;
 			if (s.et > 0) {
 				s.et -= time_mul;
 				s.rad += s.dt_rad * time_mul;
@@ -470,22 +518,51 @@ private:
 			else if (s.ft > 0) {
 				s.a -= s.dt_a * time_mul;
 			}
-			else {
-				it = smokes.erase(it);
-				continue;
-			}
+			else alive = false;
 			
-			float max = s.rad + z_max_dist;
-			if (s.ctr.dist_squ(cam.get_state().pos) > max*max) {
-				it = smokes.erase(it);
+			float lim = s.rad + z_max_dist;
+			if (!alive || s.ctr.dist_squ(cam.get_state().pos) > lim*lim) {
+				s = smokes.back();
+				smokes.pop_back();
 				continue;
 			}
-			++it;
+			++i;
+			
+			// skip those not on screen
+			const Rectfp r = Rectfp::from_center(s.ctr, {s.rad, s.rad * y_rad_k});
+			if (!r.overlaps(scr)) continue;
+			
+			vec2fp lo = max(r.lower(), scr.lower());
+			vec2fp hi = min(r.upper(), scr.upper());
+			dbg_fill += ((hi - lo) * px_per_unit).area();
+			
+			inst_data.insert(inst_data.end(), {s.ctr.x, s.ctr.y, s.rad, s.rad * y_rad_k, s.a});
+		}
+		
+		dbg_visible = inst_data.size() / inst_stride;
+		dbg_draw_calls = 1; // effect
+		
+		if (dbg_visible)
+		{
+			sh_mask->bind();
+			sh_mask->set4mx("proj", cam.get_full_matrix());
+			
+			glActiveTexture(GL_TEXTURE0);
+			tex_circ.bind();
+			
+			mask_vao.bind();
+			size_t first = inst_buf.upload(inst_data);
+			
+			// there is no base instance in GL 3.3
+			const size_t str = inst_stride * sizeof(float);
+			glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, str, reinterpret_cast<void*>(first * str));
+			glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, str, reinterpret_cast<void*>(first * str + 4 * sizeof(float)));
 			
-			sh_mask->set4f("pars", s.ctr.x, s.ctr.y, s.rad, s.rad * y_rad_k);
-			sh_mask->set1f("alpha", s.a);
-			glDrawArrays(GL_TRIANGLES, 0, 6);
+			glDrawArraysInstanced(GL_TRIANGLES, 0, 6, dbg_visible);
+			++dbg_draw_calls;
 		}
+		glViewport(0, 0, ssz.x, ssz.y);
+		dbg_fill += ssz.area();
 		
 		//
 		
@@ -658,7 +735,7 @@ public:
 			RenImm::get().render(RenImm::DEFCTX_UI);
 		});
 		
-		new PPN_InputDraw("light", PPN_InputDraw::MID_DEPTH_STENCIL, [](auto)
+		new PPN_InputDraw("light", PPN_InputDraw::MID_DEPTH_STENCIL | PPN_InputDraw::MID_SCALED, [](auto)
 		{
 			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 			glBlendEquation(GL_FUNC_ADD);
@@ -684,7 +761,7 @@ public:
 		}
 		
 		if (smoke) {
-			space_bg = new PPN_InputDraw("space_bg", PPN_InputDraw::MID_COLOR, [this](auto)
+			space_bg = new PPN_InputDraw("space_bg", PPN_InputDraw::MID_COLOR | PPN_InputDraw::MID_SCALED, [this](auto)
 			{
 				glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 				glBlendEquation(GL_FUNC_ADD);
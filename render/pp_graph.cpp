@@ -1,3 +1,4 @@
+#include "core/vig.hpp"
 #include "vaslib/vas_log.hpp"
 #include "pp_graph.hpp"
 
@@ -15,6 +16,17 @@ class PP_Graph_Impl : public PP_Graph
 {
 public:
 	struct NodeDeleter {void operator()(PP_Node* p) {delete p;}};
+	
+	static constexpr int query_frames = 4; ///< GPU timer results are read that much frames later
+	static constexpr float time_smooth = 0.05; ///< Weight of new value in averaged times
+	
+	struct Timing
+	{
+		GLuint qs[query_frames] = {}; // GL_TIME_ELAPSED queries, lazily generated
+		bool q_wait[query_frames] = {}; // is query result not yet read
+		float cpu = 0, gpu = 0; // averaged, milliseconds
+		float last_cpu = 0; // not averaged
+	};
 	struct Node
 	{
 		// input
@@ -31,16 +43,44 @@ public:
 		int self;
 		bool loopflag;
 		std::vector<int> inputs;
+		
+		Timing tm;
 	};
 	
 	std::vector<Node> nodes;
 	std::vector<Node*> ord;
 	bool rebuild_req = false;
 	
+	bool tm_gpu; // are GPU timers supported
+	int tm_frame = 0; // query index
+	float tm_total_cpu = 0, tm_total_gpu = 0;
+	float tm_last_cpu = 0;
+	RAII_Guard dbg_g;
+	
 	
 	
+	PP_Graph_Impl()
+	{
+		tm_gpu = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+		if (!tm_gpu) VLOGW("PP_Graph: timer queries not supported, GPU time won't be shown");
+		
+		dbg_g = vig_reg_menu(VigMenu::DebugRenderer, [this]
+		{
+			std::string s = "Postprocessing      CPU ms   GPU ms\n";
+			for (auto& n : ord) {
+				if (tm_gpu) s += FMT_FORMAT("  {:16} {:7.3f}  {:7.3f}\n", n->ptr->name, n->tm.cpu, n->tm.gpu);
+				else        s += FMT_FORMAT("  {:16} {:7.3f}      n/a\n", n->ptr->name, n->tm.cpu);
+			}
+			s += FMT_FORMAT("  {:16} {:7.3f}  {:7.3f}\n", "Total", tm_total_cpu, tm_total_gpu);
+			vig_label(s);
+		});
+	}
 	~PP_Graph_Impl()
 	{
+		for (auto& n : nodes) {
+			for (auto& q : n.tm.qs)
+				if (q) glDeleteQueries(1, &q);
+		}
 		nodes.clear();
 	}
 	void connect(std::string out_name, std::string in_name, int ordering) override
@@ -65,6 +105,19 @@ public:
 		n_out.output = n_in.self;
 		n_out.order = ordering;
 	}
+	float get_frame_time() override
+	{
+		return tm_gpu ? tm_total_gpu : tm_total_cpu;
+	}
+	float get_last_cpu(std::string_view name) override
+	{
+		if (name.empty()) return tm_last_cpu;
+		for (auto& n : ord) {
+			if (n->ptr->name == name)
+				return n->tm.last_cpu;
+		}
+		return 0;
+	}
 	void render() override
 	{
 		for (auto& n : nodes)
@@ -80,12 +133,51 @@ public:
 		if (rebuild_req)
 			rebuild();
 		
+		tm_frame = (tm_frame + 1) % query_frames;
+		tm_total_cpu = tm_total_gpu = tm_last_cpu = 0;
+		
 		for (auto& s : ord)
 		{
 			auto fbo = s->res >= 0 ? nodes[s->res].ptr->get_input_fbo() : 0;
+			
+			auto& tm = s->tm;
+			GLuint query = tm_gpu ? timer_query(tm) : 0;
+			if (query) glBeginQuery(GL_TIME_ELAPSED, query);
+			
+			auto t0 = TimeSpan::current();
 			s->ptr->proc(fbo);
+			float cpu = (TimeSpan::current() - t0).seconds() * 1000;
+			
+			if (query) glEndQuery(GL_TIME_ELAPSED);
+			
+			tm.last_cpu = cpu;
+			tm.cpu = lerp(tm.cpu, cpu, time_smooth);
+			tm_last_cpu += cpu;
+			tm_total_cpu += tm.cpu;
+			tm_total_gpu += tm.gpu;
 		}
 	}
+	/// Reads result of query issued several frames ago, returns query to use in this frame or 0
+	GLuint timer_query(Timing& tm)
+	{
+		auto& q = tm.qs[tm_frame];
+		if (!q) glGenQueries(1, &q);
+		
+		auto& wait = tm.q_wait[tm_frame];
+		if (wait)
+		{
+			GLint ok = 0;
+			glGetQueryObjectiv(q, GL_QUERY_RESULT_AVAILABLE, &ok);
+			if (!ok) return 0; // skip this frame rather than stall
+			
+			GLuint64 ns = 0;
+			glGetQueryObjectui64v(q, GL_QUERY_RESULT, &ns);
+			tm.gpu = lerp(tm.gpu, ns * 1e-6f, time_smooth);
+		}
+		
+		wait = true;
+		return q;
+	}
 	void add_node(PP_Node* node) override
 	{
 		for (auto& n : nodes) {
@@ -216,6 +308,12 @@ PPN_Chain::PPN_Chain(std::string name, std::vector<std::unique_ptr<PP_Filter>> f
 			fbo_s[i].check_throw(FMT_FORMAT("PPN_Chain({}) {}", this->name, i));
 		}
 	});
+	dbg_g = vig_reg_menu(VigMenu::DebugRenderer, [this]
+	{
+		// read and write of RGBA8 per pass
+		float traffic = dbg_passes * RenderControl::get_size().area() * 4 * 2;
+		vig_label_a("Chain {:5}: {} passes ({} filters fused), {:.1f} MB\n", this->name, dbg_passes, dbg_fused, traffic / (1024*1024));
+	});
 }
 bool PPN_Chain::prepare()
 {
@@ -239,16 +337,78 @@ void PPN_Chain::proc(GLuint output_fbo)
 	size_t last = fts.size() - 1;
 	for (; last; --last) if (fts[last]->enabled && fts[last]->is_ok()) break;
 	
+	dbg_passes_cur = 0;
+	dbg_fused_cur = 0;
 	bs_index = true;
+	fused_tmp.clear();
+	
 	for (size_t i=0; i <= last; ++i)
 	{
 		auto& f = fts[i];
-		if (f->enabled && f->is_ok())
+		if (!f->enabled || !f->is_ok()) continue;
+		
+		if (auto st = f->fused_stage())
 		{
-			bs_last = (i == last);
-			f->proc();
+			if (!fused_tmp.empty() && fused_tmp.back()->fused_stage()->order >= st->order)
+				proc_fused(false);
+			
+			fused_tmp.push_back(f.get());
+			continue;
+		}
+		
+		proc_fused(false);
+		bs_last = (i == last);
+		f->proc();
+	}
+	proc_fused(true);
+	
+	dbg_passes = dbg_passes_cur;
+	dbg_fused = dbg_fused_cur;
+}
+void PPN_Chain::proc_fused(bool is_last)
+{
+	if (fused_tmp.empty()) return;
+	bs_last = is_last;
+	
+	if (fused_tmp.size() == 1) {
+		fused_tmp[0]->proc();
+		fused_tmp.clear();
+		return;
+	}
+	
+	std::string key;
+	for (auto& f : fused_tmp) {
+		key += f->fused_stage()->def;
+		key += ' ';
+	}
+	
+	auto& sh = fused_shs[key];
+	if (!sh) {
+		// set_def() resets program, so build only after all defines are set
+		sh = Shader::load("pp/fused", {}, false, false);
+		for (auto& f : fused_tmp) {
+			auto def = f->fused_stage()->def;
+			sh->set_def(def, "1");
+			if (auto d = sh->get_def(def)) d->is_default = false;
+		}
+		sh->rebuild();
+	}
+	
+	if (sh->is_ok())
+	{
+		sh->bind();
+		for (auto& f : fused_tmp) f->fused_proc(*sh);
+		draw(true);
+		dbg_fused_cur += fused_tmp.size();
+	}
+	else {
+		// fallback
+		for (size_t i=0; i < fused_tmp.size(); ++i) {
+			bs_last = is_last && i == fused_tmp.size() - 1;
+			fused_tmp[i]->proc();
 		}
 	}
+	fused_tmp.clear();
 }
 GLuint PPN_Chain::get_input_fbo()
 {
@@ -276,33 +436,41 @@ void PPN_Chain::draw(bool is_last)
 	tex_s[!bs_index].bind();
 	glDrawArrays(GL_TRIANGLES, 0, 6);
 	bs_index = !bs_index;
+	++dbg_passes_cur;
 }
 
 
 
-PPN_InputDraw::PPN_InputDraw(std::string name, Middle_FBO mid_fbo, std::function<void(GLuint fbo)> func,
+PPN_InputDraw::PPN_InputDraw(std::string name, int mid_fbo, std::function<void(GLuint fbo)> func,
                              std::function<bool()> custom_prepare)
     : PP_Node(name, false, true), func(std::move(func)), custom_prepare(std::move(custom_prepare))
 {
 	pass = Shader::load("pp/pass", {}, true);
+	scaled = mid_fbo & MID_SCALED;
+	mid_fbo &= ~MID_SCALED;
+	
 	if (mid_fbo)
 	{
 		fbo.emplace();
-		fbo_g = RenderControl::get().add_size_cb([this, mid_fbo, name]
+		auto cb = [this, mid_fbo, name]
 		{
+			vec2i size = scaled ? RenderControl::get().get_offscreen_size() : RenderControl::get_size();
+			
 			if (fbo->em_texs.empty()) fbo->em_texs.emplace_back();
-			fbo->em_texs[0].set(GL_RGBA, RenderControl::get_size(), 0, 4);
+			fbo->em_texs[0].set(GL_RGBA, size, 0, 4);
 			fbo->attach_tex(GL_COLOR_ATTACHMENT0, fbo->em_texs[0]);
 			
 			if (mid_fbo == MID_DEPTH_STENCIL)
 			{
 				if (fbo->em_rbufs.empty()) fbo->em_rbufs.emplace_back();
-				fbo->em_rbufs[0].set(GL_DEPTH24_STENCIL8, RenderControl::get_size());
+				fbo->em_rbufs[0].set(GL_DEPTH24_STENCIL8, size);
 				fbo->attach_rbf(GL_DEPTH_STENCIL_ATTACHMENT, fbo->em_rbufs[0]);
 			}
 			
 			fbo->check_throw(FMT_FORMAT("PPN_InputDraw - {}", name));
-		});
+		};
+		if (scaled) fbo_g = RenderControl::get().add_offscreen_cb(std::move(cb));
+		else        fbo_g = RenderControl::get().add_size_cb(std::move(cb));
 	}
 }
 void PPN_InputDraw::proc(GLuint fbo_out)
@@ -313,10 +481,20 @@ void PPN_InputDraw::proc(GLuint fbo_out)
 		fbo->bind();
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 		
+		if (scaled) {
+			vec2i size = RenderControl::get().get_offscreen_size();
+			glViewport(0, 0, size.x, size.y);
+		}
+		
 		func(fbo->fbo);
 		
 		//
 		
+		if (scaled) {
+			vec2i size = RenderControl::get_size();
+			glViewport(0, 0, size.x, size.y);
+		}
+		
 		glBindFramebuffer(GL_FRAMEBUFFER, fbo_out);
 		pass->bind();
 		
@@ -1,6 +1,8 @@
 #ifndef PP_GRAPH_HPP
 #define PP_GRAPH_HPP
 
+#include <optional>
+#include <unordered_map>
 #include "vaslib/vas_cpp_utils.hpp"
 #include "vaslib/vas_types.hpp"
 #include "control.hpp"
@@ -44,6 +46,14 @@ public:
 	/// Output order - lower drawn earlier amongst providers for same target
 	virtual void connect(std::string output, std::string input, int order = 0) = 0;
 	
+	/// Returns averaged time of drawing all nodes in milliseconds - 
+	/// GPU time if timer queries are supported, CPU time otherwise
+	virtual float get_frame_time() = 0;
+	
+	/// Returns CPU time of node in last frame (not averaged) in milliseconds, 0 if it wasn't drawn. 
+	/// If name is empty, returns total for all nodes
+	virtual float get_last_cpu(std::string_view name = {}) = 0;
+	
 protected:
 	friend class Postproc_Impl;
 	static PP_Graph* init();
@@ -56,7 +66,8 @@ protected:
 
 
 
-/// Chain of fullscreen filters
+/// Chain of fullscreen filters. 
+/// Consecutive per-pixel filters are drawn in single pass with "pp/fused" shader
 class PPN_Chain : public PP_Node
 {
 public:
@@ -79,11 +90,21 @@ private:
 	
 	GLuint fbo_out;
 	
+	std::unordered_map<std::string, std::unique_ptr<Shader>> fused_shs; ///< By enabled defines
+	std::vector<PP_Filter*> fused_tmp;
+	
+	RAII_Guard dbg_g;
+	int dbg_passes = 0, dbg_passes_cur = 0; ///< Fullscreen draws
+	int dbg_fused = 0, dbg_fused_cur = 0; ///< Filters drawn by fused shader
+	
 	
 	bool prepare() override;
 	void proc(GLuint output_fbo) override;
 	GLuint get_input_fbo() override;
 	
+	/// Draws all filters from fused_tmp in single pass
+	void proc_fused(bool is_last);
+	
 	friend PP_Filter;
 	void draw(bool is_last);
 };
@@ -97,11 +118,12 @@ public:
 	enum Middle_FBO {
 		MID_NONE = 0,
 		MID_COLOR = 1,
-		MID_DEPTH_STENCIL = 2
+		MID_DEPTH_STENCIL = 2,
+		MID_SCALED = 4 ///< Flag - middle FBO has offscreen size (dynamic resolution)
 	};
 	
 	bool enabled = true;
-	PPN_InputDraw(std::string name, Middle_FBO mid_fbo, std::function<void(GLuint fbo)> func,
+	PPN_InputDraw(std::string name, int mid_fbo, std::function<void(GLuint fbo)> func,
 	              std::function<bool()> custom_prepare = {});
 	
 private:
@@ -111,6 +133,7 @@ private:
 	std::function<void(GLuint)> func;
 	std::function<bool()> custom_prepare;
 	bool alt_blend;
+	bool scaled;
 	
 	bool prepare() override {return enabled && (!custom_prepare || custom_prepare());}
 	void proc(GLuint fbo_out) override;
@@ -156,6 +179,19 @@ public:
 	bool is_ok() {return sh && sh->is_ok() && is_ok_int();}
 	virtual bool is_ok_int() {return true;}
 	
+	struct FusedStage
+	{
+		const char* def; ///< Define enabling filter code in "pp/fused" shader
+		int order; ///< Position of that code in shader
+	};
+	
+	/// Returns non-empty if filter is per-pixel and can be merged with adjacent ones. 
+	/// Only filters with increasing order are merged
+	virtual std::optional<FusedStage> fused_stage() {return {};}
+	
+	/// Same as proc(), but only sets uniforms of already bound fused shader instead of drawing
+	virtual void fused_proc(Shader&) {}
+	
 protected:
 	void draw(bool is_last) {_chain->draw(is_last);}
 	TimeSpan get_passed() {return RenderControl::get().get_passed();}
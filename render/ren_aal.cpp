@@ -1,4 +1,5 @@
 #include "client/resbase.hpp"
+#include "core/vig.hpp"
 #include "utils/noise.hpp"
 #include "vaslib/vas_cpp_utils.hpp"
 #include "vaslib/vas_log.hpp"
@@ -133,8 +134,17 @@ public:
 		size_t id;
 		FColor clr;
 	};
+	static constexpr int inst_stride = 8; ///< Floats per instance: transform (pos, cos, sin) + color
+	
+	struct InstChunk
+	{
+		Rectfp bounds; // without transform
+		size_t off, count; // vertices in buffer
+	};
+	static constexpr float chunk_cells = 16; ///< Chunk size, in grid cells
 	
 	GLA_VertexArray vao;
+	GLA_StreamBuffer vbuf{0, 7};
 	std::vector<float> data_f; // Buffer data to send
 
 	size_t objs_off = 0; ///< Last vertex count
@@ -149,9 +159,21 @@ public:
 	// for instanced drawing
 	GLA_VertexArray inst_vao;
 	std::vector<std::pair<size_t, size_t>> inst_objs;
+	std::vector<std::vector<InstChunk>> inst_chunks; // same indices as inst_objs; empty if not chunked
+	std::vector<std::pair<size_t, size_t>> inst_chains; // vertex ranges of current object chains
+	float chunk_size = 1;
 	std::vector<InstObj> inst_q;
+	std::vector<float> inst_data; // instance buffer data to send
+	GLA_StreamBuffer inst_buf{0, inst_stride};
 	bool inst_locked = false; // prevent render while building in process
 	
+	RAII_Guard dbg_g;
+	size_t dbg_draw_calls = 0; // last frame
+	size_t dbg_instances = 0; // last frame, equal to draw calls without instancing
+	size_t dbg_triangles = 0; // last frame, instanced only
+	size_t dbg_draw_calls_cur = 0;
+	size_t dbg_triangles_cur = 0;
+	
 	// for grid
 	GLA_Framebuffer fbo;
 	GLA_Texture fbo_clr;
@@ -258,18 +280,22 @@ public:
 	
 	RenAAL_Impl()
 	{
-		auto buf = std::make_shared<GLA_Buffer>(0);
-		vao.set_attribs({ {buf, 4}, {buf, 3} });
+		vao.set_attribs({ {vbuf.buf, 4}, {vbuf.buf, 3} });
 		
 		sh      = Shader::load("aal", {}, true);
 		sh_inst = Shader::load("aal_inst", {}, true);
 		
+		dbg_g = vig_reg_menu(VigMenu::DebugRenderer, [this]{
+			vig_label_a("AAL instances: {:4}, draw calls: {:3}\nAAL triangles: {:7}\n",
+			            dbg_instances, dbg_draw_calls, dbg_triangles);
+		});
+		
 		reinit_glow();
 		
 		// for grid
 		
 		fbo_sh = Shader::load("pp/aal_grid", {[](Shader& sh){ sh.set1i("noi", 1); }});
-		fbo_g = RenderControl::get().add_size_cb([this]{ fbo_clr.set(GL_RGBA, RenderControl::get_size(), 0, 4); }, true);
+		fbo_g = RenderControl::get().add_offscreen_cb([this]{ fbo_clr.set(GL_RGBA, RenderControl::get().get_offscreen_size(), 0, 4); }, true);
 
 		fbo.bind();
 		fbo.attach_tex(GL_COLOR_ATTACHMENT0, fbo_clr);
@@ -344,7 +370,7 @@ public:
 		
 		if (!objs.empty())
 		{
-			vao.bufs[0]->update( data_f.size(), data_f.data() );
+			size_t v0 = vbuf.upload(data_f);
 			vao.bind();
 			
 			sh->bind();
@@ -354,7 +380,7 @@ public:
 			for (auto& o : objs)
 			{
 				sh->set_rgba("clr", o.clr, o.clr_mul);
-				glDrawArrays(GL_TRIANGLES, o.off, o.count);
+				glDrawArrays(GL_TRIANGLES, v0 + o.off, o.count);
 			}
 			
 			data_f.clear();
@@ -363,26 +389,89 @@ public:
 			prev_clr = 0;
 			prev_clr_mul = 0;
 		}
+		
+		dbg_instances = inst_q.size();
+		
 		if (!inst_q.empty())
 		{
+			// one draw call per model
+			
+			std::stable_sort(inst_q.begin(), inst_q.end(), [](auto& a, auto& b) {return a.id < b.id;});
+			
+			inst_data.clear();
+			inst_data.reserve(inst_q.size() * inst_stride);
+			for (auto& o : inst_q)
+			{
+				auto cs = cossin_lut(o.tr.rot);
+				inst_data.insert(inst_data.end(), {o.tr.pos.x, o.tr.pos.y, cs.x, cs.y,
+				                                   o.clr.r, o.clr.g, o.clr.b, o.clr.a});
+			}
+			
 			inst_vao.bind();
+			size_t first = inst_buf.upload(inst_data);
 			
 			sh_inst->bind();
 			sh_inst->set4mx("proj", mx);
 			sh_inst->set1f("scrmul", scrmul);
 			
-			for (auto& o : inst_q)
+			for (size_t i = 0; i < inst_q.size(); )
 			{
-				auto cs = cossin_lut(o.tr.rot);
-				sh_inst->set4f("obj_tr", o.tr.pos.x, o.tr.pos.y, cs.x, cs.y);
-				sh_inst->set_clr("clr", o.clr);
+				size_t id = inst_q[i].id;
+				size_t n = 1;
+				while (i + n < inst_q.size() && inst_q[i + n].id == id) ++n;
 				
-				auto& p = inst_objs[o.id];
-				glDrawArrays(GL_TRIANGLES, p.first, p.second);
+				if (inst_chunks[id].empty()) {
+					auto& p = inst_objs[id];
+					draw_inst_range(first + i, n, p.first, p.second);
+				}
+				else {
+					for (size_t j = i; j < i + n; ++j)
+						draw_inst_chunks(first + j, id, inst_q[j].tr.pos);
+				}
+				i += n;
 			}
 			
 			inst_q.clear();
 		}
+		
+		dbg_draw_calls = dbg_draw_calls_cur;
+		dbg_triangles  = dbg_triangles_cur;
+		dbg_draw_calls_cur = 0;
+		dbg_triangles_cur  = 0;
+	}
+	/// Instance buffer and VAO must be bound. 
+	/// There is no base instance in GL 3.3, so attribute offsets are changed instead
+	void draw_inst_range(size_t first, size_t count, size_t vert_off, size_t vert_count)
+	{
+		const size_t str = inst_stride * sizeof(float);
+		glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, str, reinterpret_cast<void*>(first * str));
+		glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, str, reinterpret_cast<void*>(first * str + 4 * sizeof(float)));
+		
+		glDrawArraysInstanced(GL_TRIANGLES, vert_off, vert_count, count);
+		++dbg_draw_calls_cur;
+		dbg_triangles_cur += vert_count / 3 * count;
+	}
+	/// Draws only chunks visible on screen, merging adjacent ones. 
+	/// Instance rotation is ignored - chunked objects are static level geometry
+	void draw_inst_chunks(size_t inst, size_t id, vec2fp offset)
+	{
+		auto& cam = RenderControl::get().get_world_camera();
+		vec2fp hsz = cam.coord_size() / 2;
+		if (cam.get_state().rot) hsz = vec2fp::one(hsz.len());
+		const Rectfp vport = Rectfp::from_center(cam.get_state().pos - offset, hsz);
+		
+		size_t off = 0, count = 0;
+		for (auto& c : inst_chunks[id])
+		{
+			if (!c.bounds.overlaps(vport)) continue;
+			if (count && off + count == c.off) count += c.count;
+			else {
+				if (count) draw_inst_range(inst, 1, off, count);
+				off = c.off;
+				count = c.count;
+			}
+		}
+		if (count) draw_inst_range(inst, 1, off, count);
 	}
 	void render_grid(unsigned int fbo_out)
 	{
@@ -392,7 +481,9 @@ public:
 		
 		// draw to buffer
 		
+		vec2i ofs_size = RenderControl::get().get_offscreen_size();
 		fbo.bind();
+		glViewport(0, 0, ofs_size.x, ofs_size.y);
 		glClearColor(0, 0, 0, 0);
 		glClear(GL_COLOR_BUFFER_BIT);
 		
@@ -413,16 +504,19 @@ public:
 		
 //		FColor clr(0, 0.8, 1, 0.3);
 //		clr *= clr.a;
-		const FColor clr(1, 1, 1, 1);
-		
-		sh_inst->set4f("obj_tr", 0, 0, 1, 0);
-		sh_inst->set_clr("clr", clr);
+		const float inst[inst_stride] = {0, 0, 1, 0, 1, 1, 1, 1};
+		size_t first = inst_buf.upload(inst_stride, inst);
 		
-		auto& p = inst_objs[MODEL_LEVEL_GRID];
-		glDrawArrays(GL_TRIANGLES, p.first, p.second);
+		if (inst_chunks[MODEL_LEVEL_GRID].empty()) {
+			auto& p = inst_objs[MODEL_LEVEL_GRID];
+			draw_inst_range(first, 1, p.first, p.second);
+		}
+		else draw_inst_chunks(first, MODEL_LEVEL_GRID, {});
 		
 		// draw to screen
 		
+		vec2i scr_size = RenderControl::get_size();
+		glViewport(0, 0, scr_size.x, scr_size.y);
 		glBindFramebuffer(GL_FRAMEBUFFER, fbo_out);
 		
 		glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
@@ -443,8 +537,11 @@ public:
 	void inst_begin(float grid_cell_size)
 	{
 		auto buf = std::make_shared<GLA_Buffer>(0);
-		inst_vao.set_attribs({ {buf, 4}, {buf, 3} });
+		inst_vao.set_attribs({ {buf, 4}, {buf, 3}, {inst_buf.buf, 4, 1}, {inst_buf.buf, 4, 1} });
 		inst_objs.clear();
+		inst_chunks.clear();
+		inst_chains.clear();
+		chunk_size = grid_cell_size * chunk_cells;
 		
 		fbo_noi.generate(grid_cell_size);
 		inst_locked = true;
@@ -457,16 +554,72 @@ public:
 	}
 	void inst_add(const std::vector<vec2fp>& ps, bool loop, float width, float aa_width)
 	{
+		size_t v0 = data_f.size() / 7;
 		add_chain(ps, loop, width, aa_width);
+		inst_chains.emplace_back(v0, data_f.size() / 7);
 	}
-	size_t inst_add_end()
+	size_t inst_add_end(bool chunked)
 	{
 		size_t last = inst_objs.empty() ? 0 : inst_objs.back().first + inst_objs.back().second;
 		size_t cur = data_f.size() / 7;
 		size_t id = inst_objs.size();
 		inst_objs.emplace_back(last, cur - last);
+		
+		auto& chunks = inst_chunks.emplace_back();
+		if (chunked) make_chunks(chunks, last, cur);
+		inst_chains.clear();
 		return id;
 	}
+	/// Reorders vertices of current object so chains in same chunk are contiguous
+	void make_chunks(std::vector<InstChunk>& chunks, size_t v_first, size_t v_end)
+	{
+		struct Chain {
+			vec2i key; // chunk coord
+			Rectfp bounds;
+			size_t v0, v1;
+		};
+		std::vector<Chain> cs;
+		cs.reserve(inst_chains.size());
+		
+		for (auto& [v0, v1] : inst_chains)
+		{
+			if (v0 == v1) continue;
+			
+			vec2fp p0 = vec2fp::one(std::numeric_limits<float>::max());
+			vec2fp p1 = vec2fp::one(std::numeric_limits<float>::lowest());
+			for (size_t i = v0; i < v1; ++i) {
+				vec2fp p = {data_f[i*7], data_f[i*7 + 1]};
+				p0 = min(p0, p);
+				p1 = max(p1, p);
+			}
+			
+			auto& c = cs.emplace_back();
+			c.key = (((p0 + p1) / 2) / chunk_size).int_floor();
+			c.bounds = Rectfp::bounds(p0, p1);
+			c.v0 = v0;
+			c.v1 = v1;
+		}
+		
+		std::stable_sort(cs.begin(), cs.end(), [](auto& a, auto& b) {
+			return a.key.y != b.key.y ? a.key.y < b.key.y : a.key.x < b.key.x;
+		});
+		
+		std::vector<float> vs;
+		vs.reserve((v_end - v_first) * 7);
+		
+		for (size_t i = 0; i < cs.size(); ++i)
+		{
+			if (!i || cs[i].key != cs[i-1].key)
+				chunks.push_back({ cs[i].bounds, v_first + vs.size() / 7, 0 });
+			else
+				chunks.back().bounds.merge(cs[i].bounds);
+			
+			vs.insert(vs.end(), data_f.begin() + cs[i].v0 * 7, data_f.begin() + cs[i].v1 * 7);
+			chunks.back().count += cs[i].v1 - cs[i].v0;
+		}
+		
+		std::copy(vs.begin(), vs.end(), data_f.begin() + v_first * 7);
+	}
 	void draw_inst(const Transform& tr, FColor clr, size_t id)
 	{
 		reserve_more_block(inst_q, 512);
@@ -28,7 +28,11 @@ public:
 	virtual void inst_begin(float grid_cell_size) = 0; ///< Starts building new collection, discarding previous data
 	virtual void inst_end() = 0; ///< Finishes building collection
 	virtual void inst_add(const std::vector<vec2fp>& ps, bool loop, float width = 0.1f, float aa_width = 3.f) = 0; ///< New object part (chain)
-	virtual size_t inst_add_end() = 0; ///< Returns ID of finished object
+	
+	/// Returns ID of finished object. 
+	/// Chunked objects are split by position and drawn only where visible on screen; 
+	/// their instance rotation is ignored (used for static level geometry)
+	virtual size_t inst_add_end(bool chunked = false) = 0;
 	
 	virtual void draw_inst(const Transform& tr, FColor clr, size_t id) = 0; ///< Draws instanced object
 	
@@ -1,5 +1,10 @@
+#include <cstring>
+#include <list>
+#include <unordered_map>
+#include "core/vig.hpp"
 #include "vaslib/vas_cpp_utils.hpp"
 #include "vaslib/vas_log.hpp"
+#include "vaslib/vas_misc.hpp"
 #include "vaslib/vas_types.hpp"
 #include "camera.hpp"
 #include "control.hpp"
@@ -10,18 +15,6 @@
 
 
 
-vec2i RenImm::text_size( std::string_view str )
-{
-	TextRenderInfo tri;
-	tri.str_a = str.data();
-	tri.length = str.length();
-	tri.info_only = true;
-	tri.build();
-	return tri.size.int_ceil();
-}
-
-
-
 class RenImm_Impl : public RenImm
 {
 public:
@@ -43,7 +36,6 @@ public:
 			T_SHAD, // set shader and camera matrix, index is SHAD_*
 			T_CLIP, // set clip rect, index into 'clips' or INVIX for default
 			T_TEX, // set texture, index is object
-			T_CLR, // set color, index is uint32_t
 			T_HACK_CURSOR
 		};
 		Type type;
@@ -57,13 +49,25 @@ public:
 		
 		size_t last_os = size_t_inval; // last object index for this context (see add_obj())
 		GLuint last_tex = 0; // last set texture
-		uint32_t last_clr; // last set color
 		size_t last_shad = SHAD_INITIAL; // last set shader
 	};
 	
+	/// Vertex: position, texcoord and RGBA8 color
+	struct Vert
+	{
+		float x, y, u, v;
+		uint32_t clr; ///< Bytes in RGBA order
+	};
+	
+	/// Vertex size in floats (stream buffer stride)
+	static constexpr size_t vert_floats = 5;
+	static_assert(sizeof(Vert) == vert_floats * sizeof(float));
+	
 	GLA_VertexArray vao; ///< Buffer
-	std::vector <float> data; ///< Buffer data to send
-	size_t objs_off = 0; ///< Last vertices offset (same as data.size() / 4)
+	GLA_StreamBuffer vbuf{4, vert_floats};
+	size_t vbuf_off = 0; ///< First vertex of current frame data
+	std::vector <Vert> data; ///< Buffer data to send
+	size_t objs_off = 0; ///< Last vertices offset (same as data.size())
 	
 	std::vector <ContextInternal> ctxs;
 	size_t ctx_cur = 0; ///< Current context index
@@ -77,6 +81,37 @@ public:
 	
 	std::unique_ptr<Shader> sh_default, sh_default_text;
 	
+	/// Laid-out string, ready for drawing
+	struct TextLayout
+	{
+		std::string str;
+		FontIndex font;
+		int max_width;
+		int tab_width;
+		uint32_t key_hash;
+		
+		vec2fp size;
+		std::vector<TextRenderInfo::GlyphInfo> cs; ///< Sorted by texture
+	};
+	
+	static constexpr size_t text_cache_size = 512;
+	std::list<TextLayout> text_lru; ///< Most recently used first
+	std::unordered_map<uint32_t, std::list<TextLayout>::iterator> text_map; ///< By key hash
+	
+	RAII_Guard dbg_g;
+	size_t dbg_objects = 0, dbg_draw_calls = 0; // last frame
+	size_t dbg_objects_cur = 0;
+	
+	size_t dbg_tc_hits = 0, dbg_tc_miss = 0; // last frame
+	size_t dbg_tc_hits_cur = 0, dbg_tc_miss_cur = 0;
+	TimeSpan dbg_tc_build; ///< Average build time of missed string
+	
+	
+	
+	inline void add_vert( float x, float y, float u, float v )
+	{
+		data.push_back({ x, y, u, v, 0 }); // color is set by add_obj()
+	}
 	
 	
 #define u0 tc.lower().x
@@ -90,25 +125,19 @@ public:
 	) {
 		// first triangle (11 - 21 - 12)
 		
-		data.push_back( x0 ); data.push_back( y0 );
-		data.push_back( u0 ); data.push_back( v0 );
+		add_vert( x0, y0, u0, v0 );
 		
-		data.push_back( x1 ); data.push_back( y0 );
-		data.push_back( u1 ); data.push_back( v0 );
+		add_vert( x1, y0, u1, v0 );
 		
-		data.push_back( x0 ); data.push_back( y1 );
-		data.push_back( u0 ); data.push_back( v1 );
+		add_vert( x0, y1, u0, v1 );
 		
 		// second triangle (21 - 12 - 22)
 		
-		data.push_back( x1 ); data.push_back( y0 );
-		data.push_back( u1 ); data.push_back( v0 );
+		add_vert( x1, y0, u1, v0 );
 		
-		data.push_back( x0 ); data.push_back( y1 );
-		data.push_back( u0 ); data.push_back( v1 );
+		add_vert( x0, y1, u0, v1 );
 		
-		data.push_back( x1 ); data.push_back( y1 );
-		data.push_back( u1 ); data.push_back( v1 );
+		add_vert( x1, y1, u1, v1 );
 	}
 	inline void add_rect
 	(
@@ -118,25 +147,19 @@ public:
     ) {
 		// first triangle (11 - 21 - 12)
 		
-		data.push_back( x0 ); data.push_back( y0 );
-		data.push_back( u0 ); data.push_back( v0 );
+		add_vert( x0, y0, u0, v0 );
 		
-		data.push_back( x1 ); data.push_back( y1 );
-		data.push_back( u1 ); data.push_back( v0 );
+		add_vert( x1, y1, u1, v0 );
 		
-		data.push_back( x2 ); data.push_back( y2 );
-		data.push_back( u0 ); data.push_back( v1 );
+		add_vert( x2, y2, u0, v1 );
 		
 		// second triangle (21 - 12 - 22)
 		
-		data.push_back( x1 ); data.push_back( y1 );
-		data.push_back( u1 ); data.push_back( v0 );
+		add_vert( x1, y1, u1, v0 );
 		
-		data.push_back( x2 ); data.push_back( y2 );
-		data.push_back( u0 ); data.push_back( v1 );
+		add_vert( x2, y2, u0, v1 );
 		
-		data.push_back( x3 ); data.push_back( y3 );
-		data.push_back( u1 ); data.push_back( v1 );
+		add_vert( x3, y3, u1, v1 );
 	}
 #undef u0
 #undef v0
@@ -152,13 +175,23 @@ public:
 	{
 		// called only if can_add() returned true
 		
-		size_t cou = data.size() /4 - objs_off;
+		size_t cou = data.size() - objs_off;
 		auto& cx = ctxs[ctx_cur];
 		size_t shad = is_text ? SHAD_TEXT : SHAD_MAIN; // which shader index draw with
 		
+		++dbg_objects_cur;
+		
+		const uint8_t clr_bs[4] = {
+			static_cast<uint8_t>(clr >> 24), static_cast<uint8_t>(clr >> 16),
+			static_cast<uint8_t>(clr >> 8),  static_cast<uint8_t>(clr) };
+		uint32_t clr_v;
+		std::memcpy( &clr_v, clr_bs, 4 );
+		for (size_t i = objs_off; i < objs_off + cou; ++i)
+			data[i].clr = clr_v;
+		
 		// check if can just extend previous object instead of creating another draw call
-		if (cx.last_os != size_t_inval && cx.last_tex == tex && cx.last_clr == clr && cx.last_shad == shad
-		    && (cx.cmds.empty() || cx.cmds.back().type != Cmd::T_HACK_CURSOR))
+		if (cx.last_os != size_t_inval && cx.last_tex == tex && cx.last_shad == shad
+		    && cx.cmds.back().type == Cmd::T_OBJ && cx.cmds.back().index == cx.last_os)
 		{
 			auto& b = objs[ cx.last_os ];
 			if (b.off + b.count == objs_off)
@@ -174,18 +207,7 @@ public:
 		if (cx.last_shad != shad)
 		{
 			cx.last_shad = shad;
-			cx.last_clr = clr; // shader param, so must be updated for new shader
-			
 			cx.cmds.push_back({ Cmd::T_SHAD, shad });
-			cx.cmds.push_back({ Cmd::T_CLR, clr });
-		}
-		else
-		{
-			if (cx.last_clr != clr)
-			{
-				cx.last_clr = clr;
-				cx.cmds.push_back({ Cmd::T_CLR, clr });
-			}
 		}
 		
 		if (cx.last_tex != tex)
@@ -196,6 +218,7 @@ public:
 		
 		// add object
 		
+		cx.last_os = objs.size();
 		cx.cmds.push_back({ Cmd::T_OBJ, objs.size() });
 		reserve_more_block( objs, 256 );
 		
@@ -207,7 +230,7 @@ public:
 	}
 	void reserve( int rect_count )
 	{
-		reserve_more_block( data, std::max( rect_count, 400 * (4*6) ));
+		reserve_more_block( data, std::max( rect_count, 400 ) * 6 );
 	}
 	
 	void add_rect (const Rectfp& pos, float cs, float sn, const Rectfp& tc)
@@ -256,14 +279,29 @@ public:
 		white_tex = w.get_obj();
 		white_tc = w.tc;
 		
-		vao.set_buffers({ std::make_shared<GLA_Buffer>(4) });
-		vao.bufs[0]->usage = GL_STREAM_DRAW;
+		vao.set_attrib( 0, vbuf.buf, vert_floats * sizeof(float) );
+		// VAO and vbuf are still bound by set_attrib
+		glEnableVertexAttribArray( 1 );
+		glVertexAttribPointer( 1, 4, GL_UNSIGNED_BYTE, GL_TRUE, vert_floats * sizeof(float),
+		                       reinterpret_cast<void*>( 4 * sizeof(float) ));
+		
+		dbg_g = vig_reg_menu(VigMenu::DebugRenderer, [this]{
+			vig_label_a("Imm objects: {:5}, draw calls: {:4}\n", dbg_objects, dbg_draw_calls);
+			size_t tc_total = dbg_tc_hits + dbg_tc_miss;
+			vig_label_a("Text cache: {:3.0f}% hits of {:4}, ~{:.3f} ms saved\n",
+			            tc_total ? 100. * dbg_tc_hits / tc_total : 0., tc_total,
+			            dbg_tc_build.seconds() * dbg_tc_hits * 1000);
+		});
 		
 		ctxs.resize(DEFCTX_NONE);
 		Context* cx;
 
 		sh_default      = Shader::load("imm", {}, true);
-		sh_default_text = Shader::load("imm_text", {}, true);
+		Shader::Callbacks text_cbs;
+		text_cbs.pre_build = [](Shader& sh) {
+			sh.set_def("SDF", RenText::get().is_sdf() ? "1" : "0");
+		};
+		sh_default_text = Shader::load("imm_text", std::move(text_cbs), true);
 		
 		cx = &ctxs[DEFCTX_WORLD].ctx;
 		cx->sh      = sh_default.get();
@@ -437,17 +475,11 @@ public:
 		
 		auto add = [&](vec2fp p1, vec2fp p2)
 		{
-			data.push_back( pos.x ); data.push_back( pos.y );
-			data.push_back( white_tc.center().x );
-			data.push_back( white_tc.center().y );
+			add_vert( pos.x, pos.y, white_tc.center().x, white_tc.center().y );
 			
-			data.push_back( p1.x ); data.push_back( p1.y );
-			data.push_back( white_tc.center().x );
-			data.push_back( white_tc.center().y );
+			add_vert( p1.x, p1.y, white_tc.center().x, white_tc.center().y );
 			
-			data.push_back( p2.x ); data.push_back( p2.y );
-			data.push_back( white_tc.center().x );
-			data.push_back( white_tc.center().y );
+			add_vert( p2.x, p2.y, white_tc.center().x, white_tc.center().y );
 		};
 		
 		for (int i=1; i<segn; i++) add(segs[i-1], segs[i]);
@@ -465,18 +497,35 @@ public:
 	{
 		if (tri.cs.empty()) return;
 		if (!can_add( true )) return;
-		fix_text_size_k(size_k);
-		if (center) at -= tri.size * size_k / 2;
 		
-		// reduce number of texture switches for multiple atlases
+		sort_glyphs(tri.cs);
+		draw_glyphs(at, tri.cs, tri.size, clr, center, size_k);
+	}
+	void draw_text (vec2fp at, std::string_view str, uint32_t clr, bool center, float size_k, FontIndex font)
+	{
+		if (!can_add( true )) return;
+		
+		auto& lt = get_layout(str, font);
+		if (lt.cs.empty()) return;
+		draw_glyphs(at, lt.cs, lt.size, clr, center, size_k);
+	}
+	/// Reduces number of texture switches for multiple atlases
+	static void sort_glyphs(std::vector<TextRenderInfo::GlyphInfo>& cs)
+	{
 		auto cmp = [](auto &&a, auto &&b) {return a.tex.get_obj() < b.tex.get_obj();};
-		if (!std::is_sorted( tri.cs.begin(), tri.cs.end(), cmp ))
-			std::sort( tri.cs.begin(), tri.cs.end(), cmp );
+		if (!std::is_sorted( cs.begin(), cs.end(), cmp ))
+			std::sort( cs.begin(), cs.end(), cmp );
+	}
+	/// Glyphs must be sorted and not empty
+	void draw_glyphs (vec2fp at, const std::vector<TextRenderInfo::GlyphInfo>& cs, vec2fp size, uint32_t clr, bool center, float size_k)
+	{
+		fix_text_size_k(size_k);
+		if (center) at -= size * size_k / 2;
 		
-		auto prev = tri.cs.front().tex.tex;
+		auto prev = cs.front().tex.tex;
 		
-		reserve( tri.cs.size() );
-		for (auto &c : tri.cs)
+		reserve( cs.size() );
+		for (auto &c : cs)
 		{
 			if (prev != c.tex.tex)
 			{
@@ -489,16 +538,63 @@ public:
 		
 		add_obj( prev->get_obj(), clr, true );
 	}
-	void draw_text (vec2fp at, std::string_view str, uint32_t clr, bool center, float size_k, FontIndex font)
+	/// Returns layout from cache, building it if needed
+	const TextLayout& get_layout(std::string_view str, FontIndex font)
 	{
-		if (!can_add( true )) return;
-
+		const int max_width = std::numeric_limits<int>::max();
+		const int tab_width = RenText::get().tab_width;
+		
+		uint32_t key = fast_hash32(str);
+		key = key * 31 + static_cast<uint32_t>(font);
+		key = key * 31 + static_cast<uint32_t>(max_width);
+		key = key * 31 + static_cast<uint32_t>(tab_width);
+		
+		auto it = text_map.find(key);
+		if (it != text_map.end())
+		{
+			auto& lt = *it->second;
+			if (lt.str == str && lt.font == font && lt.max_width == max_width && lt.tab_width == tab_width)
+			{
+				++dbg_tc_hits_cur;
+				text_lru.splice(text_lru.begin(), text_lru, it->second);
+				return lt;
+			}
+			
+			// hash collision - replace
+			text_lru.erase(it->second);
+			text_map.erase(it);
+		}
+		
+		++dbg_tc_miss_cur;
+		auto t0 = TimeSpan::current();
+		
 		TextRenderInfo tri;
 		tri.str_a = str.data();
 		tri.length = str.length();
 		tri.font = font;
+		tri.max_width = max_width;
+		tri.tab_width = tab_width;
 		tri.build();
-		draw_text( at, tri, clr, center, size_k );
+		sort_glyphs(tri.cs);
+		
+		if (text_lru.size() >= text_cache_size) {
+			text_map.erase(text_lru.back().key_hash);
+			text_lru.pop_back();
+		}
+		
+		auto& lt = text_lru.emplace_front();
+		lt.str = str;
+		lt.font = font;
+		lt.max_width = max_width;
+		lt.tab_width = tab_width;
+		lt.size = tri.size;
+		lt.cs = std::move(tri.cs);
+		lt.key_hash = key;
+		text_map.emplace(key, text_lru.begin());
+		
+		auto dt = TimeSpan::current() - t0;
+		dbg_tc_build = dbg_tc_build.micro() ? lerp(dbg_tc_build, dt, 0.05f) : dt;
+		return lt;
 	}
 	void draw_text (vec2fp at, std::vector<std::pair<FColor, std::string>> strs)
 	{
@@ -557,10 +653,7 @@ public:
 	{
 		reserve(vs.size() / 6);
 		for (auto& v : vs) {
-			data.push_back(v.x);
-			data.push_back(v.y);
-			data.push_back(white_tc.center().x);
-			data.push_back(white_tc.center().y);
+			add_vert( v.x, v.y, white_tc.center().x, white_tc.center().y );
 		}
 	}
 	void draw_vertices_end(uint32_t clr)
@@ -606,25 +699,19 @@ public:
 	}
 	void raw_vertices(size_t vert_num, const vec2fp *vert_pos, const vec2fp *uv)
 	{
-		data.reserve(4 * vert_num);
+		data.reserve(data.size() + vert_num);
 		for (size_t i=0; i < vert_num; ++i)
 		{
-			data.push_back( vert_pos[i].x );
-			data.push_back( vert_pos[i].y );
-			data.push_back( uv[i].x );
-			data.push_back( uv[i].y );
+			add_vert( vert_pos[i].x, vert_pos[i].y, uv[i].x, uv[i].y );
 		}
 	}
 	void raw_vertices(size_t vert_num, const vec2fp *vert_pos)
 	{
-		data.reserve(4 * vert_num);
+		data.reserve(data.size() + vert_num);
 		vec2fp uv = white_tc.center();
 		for (size_t i=0; i < vert_num; ++i)
 		{
-			data.push_back( vert_pos[i].x );
-			data.push_back( vert_pos[i].y );
-			data.push_back( uv.x );
-			data.push_back( uv.y );
+			add_vert( vert_pos[i].x, vert_pos[i].y, uv.x, uv.y );
 		}
 	}
 	void raw_object(uint tex, uint32_t clr)
@@ -633,8 +720,13 @@ public:
 	}
 	void render_pre()
 	{
-		vao.bufs[0]->update(data.capacity());
-		vao.bufs[0]->update_part(0, data.size(), data.data());
+		vbuf_off = vbuf.upload(data.size() * vert_floats, data.data());
+		dbg_objects = dbg_objects_cur;
+		dbg_draw_calls = 0;
+		
+		dbg_tc_hits = dbg_tc_hits_cur;
+		dbg_tc_miss = dbg_tc_miss_cur;
+		dbg_tc_hits_cur = dbg_tc_miss_cur = 0;
 		if (!clips.empty()) glEnable(GL_SCISSOR_TEST);
 	}
 	void render(CtxIndex cx_id)
@@ -665,7 +757,8 @@ public:
 				if (hack_cursor) sh->set2f("offset", RenderControl::get().get_current_cursor());
 				{
 					auto& obj = objs[ cmd.index ];
-					glDrawArrays( GL_TRIANGLES, obj.off, obj.count );
+					glDrawArrays( GL_TRIANGLES, vbuf_off + obj.off, obj.count );
+					++dbg_draw_calls;
 				}
 				if (hack_cursor) {
 					hack_cursor = false;
@@ -682,10 +775,6 @@ public:
 				}
 				break;
 				
-			case Cmd::T_CLR:
-				sh->set_rgba( "clr", cmd.index );
-				break;
-				
 			case Cmd::T_TEX:
 				glBindTexture( GL_TEXTURE_2D, cmd.index );
 				break;
@@ -709,6 +798,7 @@ public:
 		
 		data.clear();
 		objs_off = 0;
+		dbg_objects_cur = 0;
 		
 		objs.clear();
 		clips.clear();
@@ -743,32 +833,42 @@ RenImm::~RenImm() {rni = nullptr;}
 
 
 
-void draw_text_hud (vec2fp at, std::string_view str, uint32_t clr, bool centered, float size_k)
+vec2i RenImm::text_size( std::string_view str )
 {
-	const int alpha = 0x80;
-	const int border = 4;
+	if (rni && RenderControl::get().is_rendering_thread())
+		return rni->get_layout(str, static_cast<FontIndex>(0)).size.int_ceil();
 	
 	TextRenderInfo tri;
 	tri.str_a = str.data();
 	tri.length = str.length();
+	tri.info_only = true;
 	tri.build();
-	if (tri.cs.empty()) return;
+	return tri.size.int_ceil();
+}
+
+
+
+void draw_text_hud (vec2fp at, std::string_view str, uint32_t clr, bool centered, float size_k)
+{
+	const int alpha = 0x80;
+	const int border = 4;
 	
-	tri.size *= size_k;
-	tri.size += vec2i::one(border * 2);
+	if (!rni || !rni->can_add(true)) return;
+	auto& lt = rni->get_layout(str, static_cast<FontIndex>(0));
+	if (lt.cs.empty()) return;
+	
+	vec2fp size = lt.size * size_k + vec2fp::one(border * 2);
 	auto sz = RenderControl::get_size();
-	if (at.x < 0) at.x += sz.x - tri.size.x;
-	if (at.y < 0) at.y += sz.y - tri.size.y;
+	if (at.x < 0) at.x += sz.x - size.x;
+	if (at.y < 0) at.y += sz.y - size.y;
 	
-	auto& ren = RenImm::get();
-	if (centered) ren.draw_rect(Rectfp::off_size(at - tri.size/2, tri.size), alpha);
+	if (centered) rni->draw_rect(Rectfp::off_size(at - size/2, size), alpha);
 	else {
-		ren.draw_rect(Rectfp::off_size(at, tri.size), alpha);
+		rni->draw_rect(Rectfp::off_size(at, size), alpha);
 		at += vec2fp::one(border);
 	}
 	
-	tri.size /= size_k;
-	ren.draw_text(at, tri, clr, centered, size_k);
+	rni->draw_glyphs(at, lt.cs, lt.size, clr, centered, size_k);
 }
 void draw_text_message (std::string_view str, float k_max, uint32_t clr, vec2fp direct_offset)
 {
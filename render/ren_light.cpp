@@ -1,11 +1,11 @@
-#include <mutex>
+#include <atomic>
+#include "core/vig.hpp"
 #include "camera.hpp"
 #include "control.hpp"
 #include "ren_light.hpp"
 #include "shader.hpp"
 #include "game/common_defs.hpp"
 #include "game/level_gen.hpp"
-#include "vaslib/vas_containers.hpp"
 #include "vaslib/vas_log.hpp"
 
 class RenLight_Impl : public RenLight
@@ -13,25 +13,50 @@ class RenLight_Impl : public RenLight
 public:
 	struct Light
 	{
-		int off = -1;
+		bool used = false;
+		FColor clr = {};
+		std::array<vec2fp, 4> ps = {};
+	};
+	struct Change
+	{
+		enum Type {T_ADD, T_REM, T_POS, T_CLR};
+		Type type;
+		int i;
 		FColor clr = {};
 		std::array<vec2fp, 4> ps = {};
-		
-		explicit operator bool() const {return off != -1;}
 	};
-	std::mutex lights_lock;
-	SparseArray<Light> lights;
-	bool do_update = false;
+	using ChangeList = std::vector<Change>;
+	
+	// Lights are changed by single producer thread at a time. 
+	// Changes are published through mailbox without locking; 
+	// if renderer didn't take previous list yet, new changes are appended to it
+	
+	std::atomic<ChangeList*> ch_mailbox = nullptr; // published changes
+	std::atomic<ChangeList*> ch_spare = nullptr; // cleared list returned by renderer
+	
+	// producer-side
+	std::vector<int> prod_free; // free slots
+	int prod_count = 0; // total slots
+	
+	// renderer-side
+	std::vector<Light> lights; // indexed by slot
+	int lights_existing = 0;
+	int dirty_min = 0, dirty_max = -1; // range of slots to update
 	
 	std::unique_ptr<Shader> sh, sh_mask;
 	GLA_Texture tex, mask;
 	vec2i mask_size;
 	GLA_VertexArray vao;
-	std::vector<float> vao_data;
+	std::vector<float> vao_data; // all slots
+	int vao_slots = 0; // allocated in buffer
+	
+	RAII_Guard dbg_g;
+	int dbg_slots_updated = 0; // last frame
 	
 	const int tex_size = 128; // width; height is half that
 	const int tex_fade = 32; // fade max width
 	const float clr_mul = 0.3;
+	static constexpr int slot_floats = 6*4; // per light
 	
 	RenLight_Impl()
 	{
@@ -39,7 +64,7 @@ public:
 		sh_mask = Shader::load("light_mask", {});
 		
 		vao.set_buffers({ std::make_shared<GLA_Buffer>(4) });
-		vao.bufs[0]->usage = GL_STATIC_DRAW;
+		vao.bufs[0]->usage = GL_DYNAMIC_DRAW;
 		
 		const int height = tex_size/2 + tex_fade;
 		std::vector<uint8_t> px;
@@ -54,6 +79,15 @@ public:
 		}
 		
 		tex.set(GL_R8, {tex_size, height}, 0, 1, px.data(), GL_RED);
+		
+		dbg_g = vig_reg_menu(VigMenu::DebugRenderer, [this]{
+			vig_label_a("Lights: {:4} / {:4} slots, updated: {}\n", lights_existing, lights.size(), dbg_slots_updated);
+		});
+	}
+	~RenLight_Impl()
+	{
+		delete ch_mailbox.load();
+		delete ch_spare.load();
 	}
 	void gen_wall_mask(const LevelTerrain& lt)
 	{
@@ -64,77 +98,151 @@ public:
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 		mask_size = lt.grid_size * GameConst::cell_size;
 	}
+	void publish(const Change& ch)
+	{
+		ChangeList* box = ch_mailbox.exchange(nullptr, std::memory_order_acq_rel);
+		if (!box) {
+			box = ch_spare.exchange(nullptr, std::memory_order_acq_rel);
+			if (!box) box = new ChangeList;
+		}
+		box->push_back(ch);
+		box = ch_mailbox.exchange(box, std::memory_order_acq_rel);
+		delete box; // always null, single producer
+	}
 	int add_light()
 	{
-		std::unique_lock lock(lights_lock);
-		int i = lights.emplace_new();
-		lights[i].off = 0;
-		do_update = true;
+		int i;
+		if (prod_free.empty()) i = prod_count++;
+		else {
+			i = prod_free.back();
+			prod_free.pop_back();
+		}
+		publish({ Change::T_ADD, i });
 		return i;
 	}
 	void rem_light(int i)
 	{
-		std::unique_lock lock(lights_lock);
-		lights.free_and_reset(i);
-		do_update = true;
+		prod_free.push_back(i);
+		publish({ Change::T_REM, i });
 	}
 	void set_light(int i, vec2fp ctr, float radius, float angle)
 	{
-		std::unique_lock lock(lights_lock);
-		auto& lt = lights[i];
-		do_update = true;
-		
 		vec2fp fw = vec2fp(radius, 0).fastrotate(angle + M_PI);
 		vec2fp sd = vec2fp(fw).rot90cw();
 		ctr -= fw * (float(tex_fade) / tex_size);
 		
-		lt.ps[0] = ctr - sd;
-		lt.ps[1] = ctr + sd;
-		lt.ps[2] = ctr - sd + fw;
-		lt.ps[3] = ctr + sd + fw;
+		Change ch{ Change::T_POS, i };
+		ch.ps[0] = ctr - sd;
+		ch.ps[1] = ctr + sd;
+		ch.ps[2] = ctr - sd + fw;
+		ch.ps[3] = ctr + sd + fw;
+		publish(ch);
 	}
 	void set_light(int i, FColor clr)
 	{
-		std::unique_lock lock(lights_lock);
-		auto& lt = lights[i];
-		do_update = true;
-		lt.clr = clr;
-		lt.clr.a *= clr_mul;
+		Change ch{ Change::T_CLR, i };
+		ch.clr = clr;
+		ch.clr.a *= clr_mul;
+		publish(ch);
 	}
-	void render()
+	/// Applies published changes
+	void take_changes()
 	{
-		std::unique_lock lock(lights_lock);
-		if (!lights.existing_count() || !sh->is_ok() || !sh_mask->is_ok() || !enabled)
-			return;
+		ChangeList* box = ch_mailbox.exchange(nullptr, std::memory_order_acq_rel);
+		if (!box) return;
 		
-		if (do_update)
+		for (auto& ch : *box)
 		{
-			do_update = false;
-			vao_data.reserve(lights.existing_count() * 6*4);
-			vao_data.clear();
+			if (ch.i >= static_cast<int>(lights.size()))
+				lights.resize(ch.i + 1);
 			
-			vec2fp ts[4] = {{0,0}, {1,0}, {0,1}, {1,1}};
-			for (auto& lt : lights) {
-				lt.off = vao_data.size() /4;
-				auto push = [&](int i){
-					vao_data.emplace_back(lt.ps[i].x);
-					vao_data.emplace_back(lt.ps[i].y);
-					vao_data.emplace_back(ts[i].x);
-					vao_data.emplace_back(ts[i].y);
-				};
-				// first triangle (11 - 21 - 12)
-				push(0);
-				push(1);
-				push(2);
-				// second triangle (21 - 12 - 22)
-				push(1);
-				push(2);
-				push(3);
+			auto& lt = lights[ch.i];
+			switch (ch.type)
+			{
+			case Change::T_ADD:
+				lt = {};
+				lt.used = true;
+				++lights_existing;
+				break;
+				
+			case Change::T_REM:
+				lt = {};
+				--lights_existing;
+				break;
+				
+			case Change::T_POS:
+				lt.ps = ch.ps;
+				break;
+				
+			case Change::T_CLR:
+				lt.clr = ch.clr;
+				break;
 			}
 			
+			if (dirty_min > dirty_max) dirty_min = dirty_max = ch.i;
+			else {
+				dirty_min = std::min(dirty_min, ch.i);
+				dirty_max = std::max(dirty_max, ch.i);
+			}
+		}
+		
+		box->clear();
+		box = ch_spare.exchange(box, std::memory_order_acq_rel);
+		delete box;
+	}
+	/// Rewrites only changed slots in buffer
+	void update_buffer()
+	{
+		dbg_slots_updated = 0;
+		if (dirty_min > dirty_max) return;
+		
+		vao_data.resize(lights.size() * slot_floats);
+		
+		const vec2fp ts[4] = {{0,0}, {1,0}, {0,1}, {1,1}};
+		for (int li = dirty_min; li <= dirty_max; ++li)
+		{
+			auto& lt = lights[li];
+			float* d = vao_data.data() + li * slot_floats;
+			
+			auto push = [&](int i){
+				*d++ = lt.ps[i].x;
+				*d++ = lt.ps[i].y;
+				*d++ = ts[i].x;
+				*d++ = ts[i].y;
+			};
+			// first triangle (11 - 21 - 12)
+			push(0);
+			push(1);
+			push(2);
+			// second triangle (21 - 12 - 22)
+			push(1);
+			push(2);
+			push(3);
+		}
+		
+		if (vao_slots < static_cast<int>(lights.size()))
+		{
+			vao_slots = lights.size();
 			vao.bufs[0]->update(vao_data);
+			dbg_slots_updated = vao_slots;
+		}
+		else {
+			vao.bufs[0]->update_part(dirty_min * slot_floats, (dirty_max - dirty_min + 1) * slot_floats,
+			                         vao_data.data() + dirty_min * slot_floats);
+			dbg_slots_updated = dirty_max - dirty_min + 1;
 		}
 		
+		dirty_min = 0;
+		dirty_max = -1;
+	}
+	void render()
+	{
+		take_changes();
+		if (!lights_existing || !sh->is_ok() || !sh_mask->is_ok() || !enabled)
+			return;
+		
+		update_buffer();
+		
 		// draw mask
 		
 		glEnable(GL_STENCIL_TEST);
@@ -163,9 +271,10 @@ public:
 		sh->set4mx("proj", RenderControl::get().get_world_camera().get_full_matrix());
 		vao.bind();
 		
-		for (auto& lt : lights) {
-			sh->set_clr("clr", lt.clr);
-			glDrawArrays(GL_TRIANGLES, lt.off, 6);
+		for (size_t i=0; i < lights.size(); ++i) {
+			if (!lights[i].used) continue;
+			sh->set_clr("clr", lights[i].clr);
+			glDrawArrays(GL_TRIANGLES, i * 6, 6);
 		}
 		
 		glDisable(GL_STENCIL_TEST);
@@ -1,5 +1,10 @@
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 #include "core/vig.hpp"
 #include "utils/noise.hpp"
+#include "vaslib/vas_cpp_utils.hpp"
 #include "vaslib/vas_log.hpp"
 #include "camera.hpp"
 #include "control.hpp"
@@ -28,19 +33,54 @@ void ParticleGroupGenerator::draw(const ParticleBatchPars& pars)
 {
 	RenParticles::get().add(*this, pars);
 }
+float ParticleGroupGenerator::write(const ParticleParams& p, float* d)
+{
+	float total = p.lt + p.ft;
+	
+	// pos, vel
+	d[0] = p.pos.x;
+	d[1] = p.pos.y;
+	d[2] = p.vel.x;
+	d[3] = p.vel.y;
+	d += 4;
+	
+	// left, size
+	d[0] = total;
+	d[1] = p.size;
+	d[2] = 0;
+	d[3] = 0;
+	d += 4;
+	
+	// color (calculated in shader)
+	d[0] = d[1] = d[2] = d[3] = 0;
+	d += 4;
+	
+	// acc, fade, eid
+	d[0] = p.acc.x;
+	d[1] = p.acc.y;
+	d[2] = 1.f / p.ft;
+	d[3] = 0;
+	d += 4;
+	
+	// color (const)
+	d[0] = p.clr.r;
+	d[1] = p.clr.g;
+	d[2] = p.clr.b;
+	d[3] = p.clr.a;
+	
+	return total;
+}
 
 
 
 class RenParticles_Impl : public RenParticles
 {
 public:
-	const int per_part = 5*4; // values per particle
+	const int per_part = ParticleGroupGenerator::per_part; // values per particle
 	const int part_lim_step = 10000;
 	int part_lim = 0; // max number of particles
 	
 	GLA_VertexArray vao[2];
-	std::shared_ptr<GLA_Buffer> bufs[2];
-	std::vector<float> upd_data; // buffer data
 	
 	std::unique_ptr<Shader> sh_calc, sh_draw;
 	
@@ -49,8 +89,39 @@ public:
 		TimeSpan time_left;
 	};
 	
-	std::vector<Group> gs;
+	std::vector<Group> gs; // unordered
+	std::vector<std::pair<int, int>> slots_free; // offset and size, sorted by offset
 	int gs_off_max = 0; // max currently used
+	int dbg_alive = 0; // number of particles in groups
+	
+	// generation
+	
+	struct Request {
+		ParticleGroupGenerator* gen;
+		ParticleBatchPars pars;
+	};
+	struct Batch {
+		std::vector<float> data;
+		float max_time;
+	};
+	
+	std::thread gen_thr;
+	std::mutex gen_mx;
+	std::condition_variable gen_cv, gen_done_cv;
+	bool gen_exit = false;
+	
+	std::vector<Request> gen_reqs; // pending
+	std::vector<Batch> gen_ready; // finished
+	std::vector<Batch> gen_pool; // unused, data is kept allocated
+	size_t gen_n_sent = 0, gen_n_done = 0;
+	
+	std::vector<Batch> upd_batches; // used only in render()
+	
+	// benchmark
+	
+	bool bench_req = false;
+	std::string bench_result; // protected by mutex
+	std::unordered_map<ParticleGroupGenerator*, ParticleBatchPars> bench_gens; // used only by worker
 	
 	RAII_Guard dbgm_g;
 	
@@ -72,68 +143,245 @@ public:
 		};
 		sh_calc = Shader::load("ps_calc", std::move(cbs));
 		
-		for (int i=0; i<2; ++i) {
-			bufs[i].reset( new GLA_Buffer(0) );
-			vao[i].set_attribs(std::vector<GLA_VertexArray::Attrib>(5, {bufs[i], 4}));
-		}
-		
 		resize_bufs(0);
 		sh_draw = Shader::load("ps_draw", {}, true);
 		
-		dbgm_g = vig_reg_menu(VigMenu::DebugRenderer, [this](){vig_label_a("Particles: {:5} / {:5}\n", gs_off_max, part_lim);});
+		gen_thr = std::thread([this]{
+			set_this_thread_name("particle gen");
+			gen_worker();
+		});
+		
+		dbgm_g = vig_reg_menu(VigMenu::DebugRenderer, [this]()
+		{
+			vig_label_a("Particles: {:5} / {:5} / {:5}, free ranges: {}\n",
+			            dbg_alive, gs_off_max, part_lim, slots_free.size());
+			
+			std::unique_lock lock(gen_mx);
+			if (vig_button("Benchmark particle generation") && !bench_req) {
+				bench_req = true;
+				bench_result = "Running...";
+				gen_cv.notify_one();
+			}
+			if (!bench_result.empty()) vig_label(bench_result);
+			vig_lo_next();
+		});
+	}
+	~RenParticles_Impl()
+	{
+		std::unique_lock lock(gen_mx);
+		gen_exit = true;
+		gen_cv.notify_all();
+		lock.unlock();
+		
+		gen_thr.join();
 	}
 	void resize_bufs(int additional)
 	{
 		int new_lim = part_lim + part_lim_step * (1 + additional / part_lim_step);
 		VLOGD("ParticleRenderer::add_group() limit reached: {} -> {}", part_lim, new_lim);
 		
-		std::vector<float> tmp;
-		tmp.resize(new_lim * per_part);
+		std::shared_ptr<GLA_Buffer> bufs[2];
+		for (auto& b : bufs) {
+			b.reset( new GLA_Buffer(0) );
+			b->update(new_lim * per_part);
+		}
 		
-		for (auto& b : bufs)
+		// copy only on GPU side
+		if (gs_off_max)
 		{
-			if (part_lim) b->get_part(0, part_lim * per_part, tmp.data());
-			b->update(new_lim * per_part, tmp.data());
+			glBindBuffer(GL_COPY_READ_BUFFER, vao[0].bufs[0]->vbo);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, bufs[0]->vbo);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, gs_off_max * per_part * sizeof(float));
 		}
+		
+		for (int i=0; i<2; ++i)
+			vao[i].set_attribs(std::vector<GLA_VertexArray::Attrib>(5, {bufs[i], 4}));
+		
 		part_lim = new_lim;
 	}
-	void update(TimeSpan passed)
+	
+	
+	
+	/// Returns offset
+	int slot_alloc(int num)
 	{
-		sh_calc->bind();
-		sh_calc->set1f("passed", passed.seconds());
+		for (size_t i=0; i < slots_free.size(); ++i)
+		{
+			auto& s = slots_free[i];
+			if (s.second < num) continue;
+			
+			int off = s.first;
+			s.first  += num;
+			s.second -= num;
+			if (!s.second) slots_free.erase(slots_free.begin() + i);
+			return off;
+		}
 		
-		vao[0].bind();
-		glEnable(GL_RASTERIZER_DISCARD);
-		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, vao[1].bufs[0]->vbo);
-		glBeginTransformFeedback(GL_POINTS);
+		if (gs_off_max + num > part_lim)
+			resize_bufs(num);
+		
+		int off = gs_off_max;
+		gs_off_max += num;
+		return off;
+	}
+	void slot_free(int off, int num)
+	{
+		auto it = std::lower_bound(slots_free.begin(), slots_free.end(), std::make_pair(off, 0));
+		it = slots_free.insert(it, {off, num});
 		
-		int ptr = 0, l_off, l_num = 0;
-		for (size_t gi=0; gi<gs.size(); gi++)
+		auto next = it + 1;
+		if (next != slots_free.end() && it->first + it->second == next->first) {
+			it->second += next->second;
+			slots_free.erase(next);
+		}
+		if (it != slots_free.begin()) {
+			auto prev = it - 1;
+			if (prev->first + prev->second == it->first) {
+				prev->second += it->second;
+				it = slots_free.erase(it) - 1;
+			}
+		}
+		
+		if (it->first + it->second == gs_off_max) {
+			gs_off_max = it->first;
+			slots_free.erase(it);
+		}
+	}
+	
+	
+	
+	void gen_worker()
+	{
+		std::vector<Request> reqs;
+		std::vector<Batch> bs;
+		
+		std::unique_lock lock(gen_mx);
+		while (true)
 		{
-			Group& g = gs[gi];
+			gen_cv.wait(lock, [&]{return gen_exit || bench_req || !gen_reqs.empty();});
+			if (gen_exit) break;
 			
-			g.time_left -= passed;
-			if (g.time_left.is_negative())
-			{
-				if (l_num) {
-					glDrawArrays(GL_POINTS, l_off, l_num);
-					l_num = 0;
-				}
+			if (bench_req) {
+				lock.unlock();
+				auto res = gen_benchmark();
+				lock.lock();
 				
-				gs.erase( gs.begin() + gi );
-				--gi;
-				continue;
+				bench_result = std::move(res);
+				bench_req = false;
+			}
+			
+			if (gen_reqs.empty()) continue;
+			reqs.swap(gen_reqs);
+			
+			for (size_t i=0; i < reqs.size(); ++i) {
+				if (gen_pool.empty()) bs.emplace_back();
+				else {
+					bs.emplace_back(std::move(gen_pool.back()));
+					gen_pool.pop_back();
+				}
 			}
+			lock.unlock();
 			
-			if (!l_num) l_off = g.off;
-			l_num += g.num;
+			for (size_t i=0; i < reqs.size(); ++i) {
+				bs[i].max_time = reqs[i].gen->generate(reqs[i].pars, bs[i].data);
+				bench_gens[reqs[i].gen] = reqs[i].pars;
+			}
 			
-			g.off = ptr;
-			ptr += g.num;
+			lock.lock();
+			for (auto& b : bs) gen_ready.emplace_back(std::move(b));
+			gen_n_done += reqs.size();
+			reqs.clear();
+			bs.clear();
+			gen_done_cv.notify_all();
+		}
+	}
+	/// Generates each group seen so far repeatedly, on worker thread
+	std::string gen_benchmark()
+	{
+		const int iters = 200;
+		std::vector<float> out;
+		
+		size_t total_num = 0;
+		TimeSpan total_time;
+		
+		for (auto& [gen, pars] : bench_gens)
+		{
+			auto t0 = TimeSpan::current();
+			for (int i=0; i<iters; ++i) {
+				gen->generate(pars, out);
+				total_num += out.size() / per_part;
+			}
+			total_time += TimeSpan::current() - t0;
+		}
+		
+		if (!total_num) return "No particles were generated yet";
+		return FMT_FORMAT("Generated {} groups x {}: {} particles in {:.3f} ms, {:.2f} M/s",
+		                  bench_gens.size(), iters, total_num, total_time.seconds() * 1000,
+		                  total_num / std::max(total_time.seconds(), 1e-6) / 1e6);
+	}
+	/// Uploads all requested groups, waiting for them if necessary
+	void gen_collect()
+	{
+		std::unique_lock lock(gen_mx);
+		if (gen_n_done != gen_n_sent) {
+			gen_done_cv.wait(lock, [this]{return gen_n_done == gen_n_sent;});
+		}
+		upd_batches.swap(gen_ready);
+		lock.unlock();
+		
+		for (auto& b : upd_batches)
+		{
+			int num = b.data.size() / per_part;
+			if (!num) continue;
+			
+			int off = slot_alloc(num);
+			
+			reserve_more_block(gs, 128);
+			auto& g = gs.emplace_back();
+			g.off = off;
+			g.num = num;
+			g.time_left.set_seconds(b.max_time);
+			
+			vao[0].bufs[0]->update_part(off * per_part, num * per_part, b.data.data());
+		}
+		
+		lock.lock();
+		for (auto& b : upd_batches) gen_pool.emplace_back(std::move(b));
+		upd_batches.clear();
+	}
+	
+	
+	
+	void update(TimeSpan passed)
+	{
+		for (size_t i=0; i < gs.size(); )
+		{
+			auto& g = gs[i];
+			g.time_left -= passed;
+			if (g.time_left.is_negative())
+			{
+				slot_free(g.off, g.num);
+				g = gs.back();
+				gs.pop_back();
+			}
+			else ++i;
 		}
-		if (l_num) glDrawArrays(GL_POINTS, l_off, l_num);
-		gs_off_max = ptr;
 		
+		dbg_alive = 0;
+		for (auto& g : gs) dbg_alive += g.num;
+		
+		if (!gs_off_max) return;
+		
+		// all slots are processed, dead or free ones are invisible
+		
+		sh_calc->bind();
+		sh_calc->set1f("passed", passed.seconds());
+		
+		vao[0].bind();
+		glEnable(GL_RASTERIZER_DISCARD);
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, vao[1].bufs[0]->vbo);
+		glBeginTransformFeedback(GL_POINTS);
+		glDrawArrays(GL_POINTS, 0, gs_off_max);
 		glEndTransformFeedback();
 		glDisable(GL_RASTERIZER_DISCARD);
 		
@@ -144,6 +392,7 @@ public:
 	
 	void render()
 	{
+		gen_collect();
 		if (gs.empty()) return;
 		auto passed = RenderControl::get().get_passed();
 		
@@ -159,71 +408,11 @@ public:
 	}
 	void add(ParticleGroupGenerator& group, const ParticleBatchPars& pars)
 	{
-		ParticleParams p;
-		p.acc = {};
-		
-		int num = group.begin(pars, p);
-		if (!num) {
-			group.end();
-			return;
-		}
-		
-		if (gs_off_max + num > part_lim)
-			resize_bufs(num);
-		
-		reserve_more_block(gs, 128);
-		gs.push_back({ gs_off_max, num, {} });
-		gs_off_max += num;
-		
-		// fill data
-		
-		upd_data.clear();
-		upd_data.resize(num * per_part);
-		float *data = upd_data.data();
-		
-		float max_time = 0.f;
-		
-		for (int i=0; i<num; ++i)
-		{
-			float *d = data + i * per_part;
-			group.gen(p);
-			
-			float total = p.lt + p.ft;
-			max_time = std::max(max_time, total);
-			
-			// pos, vel
-			d[0] = p.pos.x;
-			d[1] = p.pos.y;
-			d[2] = p.vel.x;
-			d[3] = p.vel.y;
-			d += 4;
-			
-			// left, size
-			d[0] = total;
-			d[1] = p.size;
-//			d[2] = 0;
-//			d[3] = 0;
-			d += 8; // +4 color calculated in shader
-			
-			// acc, fade, eid
-			d[0] = p.acc.x;
-			d[1] = p.acc.y;
-			d[2] = 1.f / p.ft;
-//			d[3] = 0;
-			d += 4;
-			
-			// color (const)
-			d[0] = p.clr.r;
-			d[1] = p.clr.g;
-			d[2] = p.clr.b;
-			d[3] = p.clr.a;
-		}
-		
-		// finish
-		
-		vao[0].bufs[0]->update_part(gs.back().off * per_part, num * per_part, data);
-		gs.back().time_left.set_seconds(max_time);
-		group.end();
+		std::unique_lock lock(gen_mx);
+		reserve_more_block(gen_reqs, 128);
+		gen_reqs.push_back({ &group, pars });
+		++gen_n_sent;
+		gen_cv.notify_one();
 	}
 };
 
@@ -1,6 +1,7 @@
 #ifndef REN_PARTICLES_HPP
 #define REN_PARTICLES_HPP
 
+#include <algorithm>
 #include <vector>
 #include "utils/color_manip.hpp"
 #include "vaslib/vas_math.hpp"
@@ -49,21 +50,58 @@ struct ParticleGroupGenerator
 {
 	virtual ~ParticleGroupGenerator() = default;
 	
-	/// Generates group with specified transformation
+	/// Generates group with specified transformation. 
+	/// Generation is done on worker thread, so generator must not be changed after first use
 	void draw(const ParticleBatchPars& pars);
 	
 protected:
 	friend class RenParticles_Impl;
 	
-	/// Begins generating new group. Returns number of particles. 
-	/// Params are already inited with zero rotations and acceleration, everything else is unset
-	virtual size_t begin(const ParticleBatchPars& pars, ParticleParams& p) = 0;
+	static constexpr size_t per_part = 5*4; ///< Values per particle in buffer
 	
-	/// Fills params, value is same since last call and call to begin
-	virtual void gen(ParticleParams& p) = 0;
+	/// Generates whole group, resizing output to per_part values per particle. 
+	/// Returns max lifetime of particles in seconds
+	virtual float generate(const ParticleBatchPars& pars, std::vector<float>& out) = 0;
 	
-	/// Group generation finished 
-	virtual void end() {}
+	/// Writes particle to buffer, returns full lifetime
+	static float write(const ParticleParams& p, float* out);
+};
+
+
+
+/// Batch generator calling functions of T without virtual dispatch:
+/// 
+/// size_t begin(const ParticleBatchPars& pars, ParticleParams& p) - 
+///    begins generating new group, returns number of particles. 
+///    Params are already inited with zero rotations and acceleration, everything else is unset
+/// 
+/// void gen(ParticleParams& p) - fills params, value is same since last call and call to begin
+/// 
+/// void end() - group generation finished (optional)
+template <typename T>
+struct ParticleGroupStd : ParticleGroupGenerator
+{
+protected:
+	float generate(const ParticleBatchPars& pars, std::vector<float>& out) override final
+	{
+		auto& self = static_cast<T&>(*this);
+		
+		ParticleParams p;
+		p.acc = {};
+		
+		size_t num = self.begin(pars, p);
+		out.resize(num * per_part);
+		
+		float max_time = 0;
+		for (size_t i=0; i<num; ++i) {
+			self.gen(p);
+			max_time = std::max(max_time, write(p, out.data() + i * per_part));
+		}
+		
+		self.end();
+		return max_time;
+	}
+	void end() {}
 };
 
 
@@ -1,8 +1,11 @@
 #include <unordered_map>
+#include "core/hard_paths.hpp"
 #include "core/settings.hpp"
+#include "vaslib/vas_file.hpp"
 #include "vaslib/vas_log.hpp"
 #include "vaslib/vas_atlas_packer.hpp"
 #include "vaslib/vas_font.hpp"
+#include "vaslib/vas_misc.hpp"
 #include "control.hpp"
 #include "ren_text.hpp"
 #include "texture.hpp"
@@ -17,9 +20,16 @@ static std::vector<std::vector<char32_t>> tui_char_get_alts() {return {};}
 
 
 
+TimeSpan TextRenderInfo::dbg_build_time;
+
 void TextRenderInfo::build()
 {
-	RenText::get().build(*this);
+	if (!RenderControl::get().is_rendering_thread()) RenText::get().build(*this);
+	else {
+		auto t0 = TimeSpan::current();
+		RenText::get().build(*this);
+		dbg_build_time += TimeSpan::current() - t0;
+	}
 }
 
 
@@ -51,6 +61,41 @@ public:
 		float line_ht;
 	};
 	
+	/// Font data before upload, can be stored in cache
+	struct FontBlob
+	{
+		struct Atlas
+		{
+			vec2i size;
+			std::vector<uint8_t> px;
+		};
+		struct Glyph
+		{
+			char32_t cp; ///< -1 for missing glyph, 0 for white rectangle
+			uint32_t atlas; ///< Index
+			Rect tx; ///< Atlas region, texels
+			vec2fp size, off; ///< Pixels
+			float xadv;
+		};
+		
+		std::vector<Atlas> atlases;
+		std::vector<Glyph> glyphs;
+		
+		bool is_mono_flag;
+		float w_mode;
+		float line_ht;
+	};
+	
+	// signed distance field atlas parameters
+	static constexpr int sdf_texel_k = 2; ///< Atlas texels per pixel
+	static constexpr int sdf_raster_k = 8; ///< Glyphs are rasterized with that much higher resolution
+	static constexpr int sdf_spread = 4; ///< Max distance, texels
+	static constexpr uint32_t sdf_cache_version = 2;
+	
+	inline static size_t dbg_atlas_bytes = 0;
+	
+	bool sdf_mode; ///< Setting value at creation; atlases can't be changed later
+	
 	std::vector <std::shared_ptr<FontData>> fonts;
 	std::unordered_map <char32_t, std::vector<char32_t>> gs_alts;
 	
@@ -61,6 +106,7 @@ public:
 		TimeSpan is_t0 = TimeSpan::current();
 		
 		auto& sets = AppSettings::get();
+		sdf_mode = sets.font_sdf;
 		fonts.resize(3);
 		
 		VLOGD("Loading default (primary) font");
@@ -88,7 +134,8 @@ public:
 			}
 		}
 		
-		VLOGI("Fonts loaded in {:.3f} seconds", (TimeSpan::current() - is_t0).seconds());
+		VLOGI("Fonts loaded in {:.3f} seconds, {} atlases - {} KB", (TimeSpan::current() - is_t0).seconds(),
+		      sdf_mode ? "SDF" : "bitmap", dbg_atlas_bytes / 1024);
 	}
 	void build (TextRenderInfo& b) override
 	{
@@ -179,6 +226,10 @@ public:
 	{
 		return gf(font).white.tex;
 	}
+	bool is_sdf() override
+	{
+		return sdf_mode;
+	}
 	bool   is_mono    ( FontIndex i ) override {return gf(i).is_mono_flag;}
 	float  width_mode ( FontIndex i ) override {return gf(i).w_mode;}
 	float  line_height( FontIndex i ) override {return gf(i).line_ht;}
@@ -198,9 +249,37 @@ public:
 	{
 		return *fonts[static_cast<size_t>(i)];
 	}
-	static std::shared_ptr<FontData> load_font(const char *fname, float pt)
+	std::shared_ptr<FontData> load_font(const char *fname, float pt)
 	{
-		const float ss_k = AppSettings::get().font_supersample;
+		if (!sdf_mode) {
+			auto b = rasterize(fname, pt, false);
+			return b ? create(*b) : nullptr;
+		}
+		
+		auto file = readfile(fname);
+		if (!file) {
+			VLOGE("RenText::load_font() can't read \"{}\"", fname);
+			return {};
+		}
+		std::string cache_key = FMT_FORMAT("{}|{} {:08x}|{} {} {} {} {} {}", fname, file->size(), fast_hash32(*file),
+		                                   pt, sdf_texel_k, sdf_raster_k, sdf_spread, sdf_cache_version,
+		                                   RenderControl::get().get_max_tex());
+		std::string cache_fn = FMT_FORMAT(HARDPATH_FONT_CACHE, fast_hash32(cache_key));
+		
+		if (auto b = read_cache(cache_fn.c_str(), cache_key)) {
+			VLOGV("RenText::load_font() loaded from cache: \"{}\"", cache_fn);
+			return create(*b);
+		}
+		
+		auto b = rasterize(fname, pt, true);
+		if (!b) return {};
+		write_cache(cache_fn.c_str(), cache_key, *b);
+		return create(*b);
+	}
+	static std::optional<FontBlob> rasterize(const char *fname, float pt, bool sdf)
+	{
+		const float ss_k = sdf ? sdf_texel_k * sdf_raster_k : AppSettings::get().font_supersample;
+		const float tx_k = sdf ? sdf_texel_k : ss_k;
 		
 		VLOGV("RenText::load_font() called: {}px (scaled to {}px) \"{}\"", pt, pt * ss_k, fname);
 		std::unique_ptr <vas::Font> font (vas::Font::load_auto (fname, pt * ss_k));
@@ -239,10 +318,9 @@ public:
 		inf.mode = 1;
 		font->update_info(inf);
 		
-		auto fd = std::make_shared<FontData>();
-		fd->is_mono_flag = inf.width != 0;
-		fd->w_mode  = inf.mode /ss_k;
-		fd->line_ht = inf.line /ss_k;
+		FontBlob fb;
+		fb.w_mode  = inf.mode /ss_k;
+		fb.line_ht = inf.line /ss_k;
 		
 		
 		// create packed alpha atlas
@@ -263,6 +341,10 @@ public:
 		// add glyphs
 		auto gs = font->get_glyphs();
 		
+		if (sdf) {
+			for (auto &g : gs) make_sdf(g);
+		}
+		
 		for (auto &g : gs)
 			abd.add_static( {g.cp, g.size.x, g.size.y}, g.image.data() );
 		
@@ -273,22 +355,76 @@ public:
 	VLOGD("Atlas built in {:.3f} seconds", is_t1.seconds());
 		
 		
-		// generate textures
 		VLOGV("  generated {} atlases", is.size());
-		fd->texs.resize( is.size() );
+		fb.atlases.resize( is.size() );
 		for (size_t i = 0; i < is.size(); ++i)
 		{
 			auto& img = is[i];
 			VLOGV("  {}: {}x{}, sprites: {}", i, img.info.w, img.info.h, img.info.sprs.size());
 			
-			fd->texs[i].reset( Texture::create_from({ img.info.w, img.info.h }, Texture::FMT_SINGLE,
-			                                        img.px.data(), Texture::FIL_LINEAR ) );
+			fb.atlases[i].size = { img.info.w, img.info.h };
+			fb.atlases[i].px = std::move(img.px);
+		}
+		
+		
+		// add symbols
+		fb.glyphs.reserve( gs.size() + 1 + alt_add.size() );
+		
+		VLOGV("  glyphs count: {}", gs.size());
+		
+		auto add = [&](char32_t cp, const auto& spr, vec2fp off, float xadv)
+		{
+			auto& rg = fb.glyphs.emplace_back();
+			rg.cp = cp;
+			rg.atlas = spr.index;
+			rg.tx = Rect::off_size( {spr.x, spr.y}, {spr.w, spr.h} );
+			rg.size = vec2fp(spr.w, spr.h) / tx_k;
+			rg.off = off / tx_k;
+			rg.xadv = xadv / ss_k;
+		};
+		
+		for (auto &fg : gs)
+		{
+			auto spr = abd.pk->get(fg.cp);
+			if (!spr) continue;
+			add(fg.cp, *spr, vec2fp(fg.off), fg.xadv);
+			
+			for (auto& p : alt_add) {
+				if (p.second == fg.cp)
+					add(p.first, *spr, vec2fp(fg.off), fg.xadv);
+			}
+		}
+		
+		fb.is_mono_flag = font->monowide_check( fb.w_mode / 6, 8 );
+		
+		// add white rect
+		if (auto spr = abd.pk->get(0)) {
+			add(0, *spr, {}, 0);
+			fb.glyphs.back().size = vec2fp(spr->w, spr->h);
+		}
+		
+		return fb;
+	}
+	static std::shared_ptr<FontData> create(FontBlob& fb)
+	{
+		auto fd = std::make_shared<FontData>();
+		fd->is_mono_flag = fb.is_mono_flag;
+		fd->w_mode  = fb.w_mode;
+		fd->line_ht = fb.line_ht;
+		
+		// generate textures
+		fd->texs.resize( fb.atlases.size() );
+		for (size_t i = 0; i < fb.atlases.size(); ++i)
+		{
+			auto& img = fb.atlases[i];
+			fd->texs[i].reset( Texture::create_from( img.size, Texture::FMT_SINGLE, img.px.data(), Texture::FIL_LINEAR ) );
+			dbg_atlas_bytes += img.px.size();
 #if DEBUG_ATLAS
 			static int fi = 0; ++fi;
 			if (!i && fi == DEBUG_ATLAS+1)
 			{
 				ImageInfo ii;
-				ii.reset({ img.info.w, img.info.h }, ImageInfo::FMT_ALPHA);
+				ii.reset(img.size, ImageInfo::FMT_ALPHA);
 				memcpy( ii.raw(), img.px.data(), img.px.size() );
 				ii.save("test.png");
 				exit(1);
@@ -296,53 +432,31 @@ public:
 #endif
 		}
 		
-		
 		// add symbols
-		fd->glyphs.reserve( gs.size() + 1 + alt_add.size() );
-		
-		VLOGV("  glyphs count: {}", gs.size());
+		fd->glyphs.reserve( fb.glyphs.size() );
 		
-		for (auto &fg : gs)
+		for (auto& fg : fb.glyphs)
 		{
-			auto spr = abd.pk->get(fg.cp);
-			if (!spr) continue;
 			Glyph rg;
 			
-			auto tex = fd->texs[ spr->index ].get();
-			rg.tex = { tex, tex->to_texcoord(Rect::off_size( {spr->x, spr->y}, {spr->w, spr->h} )) };
-			rg.size = vec2fp(spr->w, spr->h) / ss_k;
-			
-			rg.off = vec2fp(fg.off) / ss_k;
-			rg.xadv = fg.xadv /ss_k;
-//			if (fd->is_mono_flag) rg.xadv = w_mode;
+			auto tex = fd->texs[ fg.atlas ].get();
+			rg.tex = { tex, tex->to_texcoord(fg.tx) };
+			rg.size = fg.size;
+			rg.off = fg.off;
+			rg.xadv = fg.xadv;
 			
 			if (fg.cp == (char32_t) -1) fd->miss = rg;
+			else if (fg.cp == 0) {
+				rg.xadv = fd->w_mode;
+				
+				vec2fp c = rg.tex.tc.center();
+				rg.tex.tc.lower(c);
+				rg.tex.tc.upper(c);
+				fd->white = rg;
+			}
 			else fd->glyphs.emplace(fg.cp, rg);
 		}
 		
-		for (auto& p : alt_add) {
-			auto it = fd->glyphs.find(p.second);
-			fd->glyphs.emplace(p.first, it->second);
-		}
-		
-		fd->is_mono_flag = font->monowide_check( fd->w_mode / 6, 8 );
-		
-		// add white rect
-		if (auto spr = abd.pk->get(0)) {
-			Glyph& rg = fd->white;
-			
-			auto tex = fd->texs[ spr->index ].get();
-			rg.tex = { tex, tex->to_texcoord(Rect::off_size( {spr->x, spr->y}, {spr->w, spr->h} )) };
-			rg.size = vec2fp(spr->w, spr->h);
-			
-			rg.off = {};
-			rg.xadv = fd->w_mode;
-			
-			vec2fp c = rg.tex.tc.center();
-			rg.tex.tc.lower(c);
-			rg.tex.tc.upper(c);
-		}
-		
 		// make all characters monowide
 		if (fd->is_mono_flag)
 		{
@@ -362,6 +476,209 @@ public:
 		VLOGV("RenText::load_font() OK");
 		return fd;
 	}
+	
+	
+	
+	/// Converts rasterized glyph to signed distance field with sdf_raster_k times less resolution. 
+	/// Offset and size of result are in atlas texels
+	static void make_sdf(vas::Font::Glyph& g)
+	{
+		const int rk = sdf_raster_k;
+		const int pad = sdf_spread * rk;
+		
+		auto div_floor = [](int a, int b) {return a >= 0 ? a / b : -((-a + b - 1) / b);};
+		
+		if (g.image.empty() || !g.size.x || !g.size.y) {
+			g.off = {div_floor(g.off.x, rk), div_floor(g.off.y, rk)};
+			g.size = {};
+			g.image.clear();
+			return;
+		}
+		
+		// origin of padded grid is aligned to texels
+		vec2i org = {div_floor(g.off.x - pad, rk) * rk, div_floor(g.off.y - pad, rk) * rk};
+		vec2i out = (g.off + g.size + vec2i::one(pad) - org + vec2i::one(rk - 1)) / rk;
+		vec2i hs = out * rk;
+		vec2i ib = g.off - org;
+		
+		// squared distances to nearest pixel of other kind
+		const float inf = 1e20;
+		std::vector<float> d_out(hs.area()), d_in(hs.area());
+		for (int y=0; y<hs.y; ++y)
+		for (int x=0; x<hs.x; ++x)
+		{
+			vec2i p = vec2i(x, y) - ib;
+			bool inside = p.x >= 0 && p.y >= 0 && p.x < g.size.x && p.y < g.size.y
+			              && g.image[p.y * g.size.x + p.x] >= 128;
+			d_out[y * hs.x + x] = inside ? 0 : inf;
+			d_in [y * hs.x + x] = inside ? inf : 0;
+		}
+		edt(d_out, hs);
+		edt(d_in,  hs);
+		
+		g.image.resize(out.area());
+		for (int y=0; y<out.y; ++y)
+		for (int x=0; x<out.x; ++x)
+		{
+			size_t i = (y * rk + rk/2) * hs.x + (x * rk + rk/2);
+			float d = d_out[i] ? std::sqrt(d_out[i]) - 0.5f : 0.5f - std::sqrt(d_in[i]); // positive outside
+			float v = 0.5f - d / (rk * sdf_spread * 2);
+			g.image[y * out.x + x] = std::clamp(v, 0.f, 1.f) * 255 + 0.5f;
+		}
+		
+		g.off = org / rk;
+		g.size = out;
+	}
+	
+	/// Squared euclidean distance transform (Felzenszwalb & Huttenlocher), in-place. 
+	/// Zero values are features, others must be very large
+	static void edt(std::vector<float>& f, vec2i size)
+	{
+		const float inf = 1e20;
+		const int n = std::max(size.x, size.y);
+		std::vector<float> tmp(n), res(n), z(n + 1);
+		std::vector<int> v(n);
+		
+		auto pass = [&](int len)
+		{
+			int k = 0;
+			v[0] = 0;
+			z[0] = -inf;
+			z[1] = inf;
+			for (int q = 1; q < len; ++q)
+			{
+				float s;
+				while (true) {
+					int r = v[k];
+					s = ((tmp[q] + q*q) - (tmp[r] + r*r)) / (2*q - 2*r);
+					if (s > z[k]) break;
+					--k;
+				}
+				++k;
+				v[k] = q;
+				z[k] = s;
+				z[k+1] = inf;
+			}
+			k = 0;
+			for (int q = 0; q < len; ++q) {
+				while (z[k+1] < q) ++k;
+				res[q] = (q - v[k]) * (q - v[k]) + tmp[v[k]];
+			}
+		};
+		
+		for (int x=0; x<size.x; ++x) {
+			for (int y=0; y<size.y; ++y) tmp[y] = f[y * size.x + x];
+			pass(size.y);
+			for (int y=0; y<size.y; ++y) f[y * size.x + x] = res[y];
+		}
+		for (int y=0; y<size.y; ++y) {
+			for (int x=0; x<size.x; ++x) tmp[x] = f[y * size.x + x];
+			pass(size.x);
+			for (int x=0; x<size.x; ++x) f[y * size.x + x] = res[x];
+		}
+	}
+	
+	
+	
+	static std::optional<FontBlob> read_cache(const char *fname, std::string_view key)
+	{
+		std::unique_ptr<File> f(File::open(fname));
+		if (!f) return {};
+		
+		try {
+			if (f->r32L() != sdf_cache_version)
+				throw std::runtime_error("version mismatch");
+			
+			if (f->r32L() != key.size()) throw std::runtime_error("key mismatch");
+			std::string f_key(key.size(), 0);
+			if (f->read(f_key.data(), f_key.size()) != f_key.size() || f_key != key)
+				throw std::runtime_error("key mismatch");
+			
+			FontBlob fb;
+			fb.is_mono_flag = f->r8();
+			fb.w_mode  = f->rpif();
+			fb.line_ht = f->rpif();
+			
+			fb.atlases.resize(f->r32L());
+			if (fb.atlases.size() > 64) throw std::runtime_error("invalid atlas count");
+			for (auto& a : fb.atlases)
+			{
+				a.size.x = f->r32L();
+				a.size.y = f->r32L();
+				if (a.size.x <= 0 || a.size.y <= 0 || a.size.x > 32768 || a.size.y > 32768)
+					throw std::runtime_error("invalid atlas size");
+				
+				a.px.resize(a.size.area());
+				if (f->read(a.px.data(), a.px.size()) != a.px.size())
+					throw std::runtime_error("unexpected EOF");
+			}
+			
+			fb.glyphs.resize(f->r32L());
+			if (fb.glyphs.size() > 0x110000) throw std::runtime_error("invalid glyph count");
+			for (auto& g : fb.glyphs)
+			{
+				g.cp = f->r32L();
+				g.atlas = f->r32L();
+				if (g.atlas >= fb.atlases.size()) throw std::runtime_error("invalid atlas index");
+				
+				vec2i off, size;
+				off.x = f->r32L(); off.y = f->r32L();
+				size.x = f->r32L(); size.y = f->r32L();
+				g.tx = Rect::off_size(off, size);
+				
+				g.size.x = f->rpif(); g.size.y = f->rpif();
+				g.off.x = f->rpif(); g.off.y = f->rpif();
+				g.xadv = f->rpif();
+			}
+			return fb;
+		}
+		catch (std::exception& e) {
+			VLOGW("RenText::read_cache() invalid \"{}\" - {}", fname, e.what());
+			return {};
+		}
+	}
+	static void write_cache(const char *fname, std::string_view key, const FontBlob& fb)
+	{
+		std::unique_ptr<File> f(File::open(fname, File::OpenCreate));
+		if (!f) {
+			VLOGW("RenText::write_cache() can't open \"{}\"", fname);
+			return;
+		}
+		
+		try {
+			f->w32L(sdf_cache_version);
+			f->w32L(key.size());
+			if (f->write(key.data(), key.size()) != key.size())
+				throw std::runtime_error("write failed");
+			
+			f->w8(fb.is_mono_flag);
+			f->wpif(fb.w_mode);
+			f->wpif(fb.line_ht);
+			
+			f->w32L(fb.atlases.size());
+			for (auto& a : fb.atlases) {
+				f->w32L(a.size.x);
+				f->w32L(a.size.y);
+				if (f->write(a.px.data(), a.px.size()) != a.px.size())
+					throw std::runtime_error("write failed");
+			}
+			
+			f->w32L(fb.glyphs.size());
+			for (auto& g : fb.glyphs) {
+				f->w32L(g.cp);
+				f->w32L(g.atlas);
+				f->w32L(g.tx.lower().x); f->w32L(g.tx.lower().y);
+				f->w32L(g.tx.size().x);  f->w32L(g.tx.size().y);
+				f->wpif(g.size.x); f->wpif(g.size.y);
+				f->wpif(g.off.x);  f->wpif(g.off.y);
+				f->wpif(g.xadv);
+			}
+			VLOGD("RenText::write_cache() written to \"{}\"", fname);
+		}
+		catch (std::exception& e) {
+			VLOGW("RenText::write_cache() failed \"{}\" - {}", fname, e.what());
+		}
+	}
 };
 
 
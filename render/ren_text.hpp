@@ -3,6 +3,7 @@
 
 #include <vector>
 #include "vaslib/vas_math.hpp"
+#include "vaslib/vas_time.hpp"
 #include "texture.hpp"
 
 
@@ -46,6 +47,9 @@ struct TextRenderInfo
 	// funcs
 	
 	void build(); ///< Updates output info from input (calls RenText::build)
+	
+	/// Total time spent in build() on rendering thread. Reset by user
+	static TimeSpan dbg_build_time;
 };
 
 
@@ -61,6 +65,7 @@ public:
 	virtual vec2i predict_size( vec2i str_size, FontIndex font ) = 0; ///< Most probable size of such string in pixels
 	
 	virtual TextureReg get_white_rect(FontIndex font = FontIndex::Mono) = 0; ///< Returns info for 1x1 white rectangle
+	virtual bool is_sdf() = 0; ///< Are atlases signed distance fields (imm_text must be built with SDF)
 	
 	virtual bool   is_mono    (FontIndex font) = 0; ///< Is font (roughly) monowide
 	virtual float  width_mode (FontIndex font) = 0; ///< Average char width
@@ -1,9 +1,12 @@
+#include <filesystem>
 #include "core/hard_paths.hpp"
+#include "core/settings.hpp"
 #include "vaslib/vas_cpp_utils.hpp"
 #include "vaslib/vas_file.hpp"
 #include "vaslib/vas_log.hpp"
 #include "vaslib/vas_misc.hpp"
 #include "vaslib/vas_string_utils.hpp"
+#include "vaslib/vas_time.hpp"
 #include "shader.hpp"
 
 
@@ -208,6 +211,105 @@ static std::optional<size_t> get_shd(GLenum type, const std::string& fname)
 
 static std::vector<Shader*> all_shader_ptr;
 
+
+
+/// Returns true if compiled programs can be cached
+static bool bincache_available()
+{
+	static std::optional<bool> ok;
+	if (!ok) {
+		GLint n = 0;
+		if (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary)
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &n);
+		ok = n > 0;
+		if (!*ok) VLOGI("Shader:: program binaries not supported, cache disabled");
+	}
+	return *ok && AppSettings::get().shader_cache;
+}
+
+/// Part of cache key which identifies driver
+static const std::string& bincache_driver()
+{
+	static std::string s;
+	if (s.empty()) {
+		auto str = [](GLenum e) -> const char* {auto p = glGetString(e); return p ? reinterpret_cast<const char*>(p) : "";};
+		s = FMT_FORMAT("{}\n{}\n{}\n", str(GL_VENDOR), str(GL_RENDERER), str(GL_VERSION));
+	}
+	return s;
+}
+
+/// Creates program from cached binary if key matches
+static GLuint bincache_load(const std::string& fname, std::string_view key)
+{
+	auto file = readfile(fname.c_str());
+	if (!file) return 0;
+	
+	std::string_view f = *file;
+	auto r32 = [&]() -> std::optional<uint32_t> {
+		if (f.size() < 4) return {};
+		uint32_t x;
+		std::memcpy(&x, f.data(), 4);
+		f.remove_prefix(4);
+		return x;
+	};
+	
+	auto key_len = r32();
+	if (!key_len || f.size() < *key_len || f.substr(0, *key_len) != key) {
+		VLOGD("Shader:: cached binary key mismatch - \"{}\"", fname);
+		return 0;
+	}
+	f.remove_prefix(*key_len);
+	
+	auto format = r32();
+	if (!format || f.empty()) return 0;
+	
+	GLuint prog = glCreateProgram();
+	glProgramBinary(prog, *format, f.data(), f.size());
+	
+	GLint ok = GL_FALSE;
+	glGetProgramiv(prog, GL_LINK_STATUS, &ok);
+	if (ok == GL_FALSE) {
+		VLOGD("Shader:: cached binary rejected by driver - \"{}\"", fname);
+		glDeleteProgram(prog);
+		return 0;
+	}
+	return prog;
+}
+
+/// Stores binary of linked program
+static void bincache_save(const std::string& fname, std::string_view key, GLuint prog)
+{
+	GLint len = 0;
+	glGetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH, &len);
+	if (len <= 0) return;
+	
+	std::string data;
+	data.resize(4 + key.size() + 4 + len);
+	char* p = data.data();
+	
+	uint32_t key_len = key.size();
+	std::memcpy(p, &key_len, 4); p += 4;
+	std::memcpy(p, key.data(), key.size()); p += key.size();
+	
+	GLenum format = 0;
+	GLsizei got = 0;
+	glGetProgramBinary(prog, len, &got, &format, p + 4);
+	if (got <= 0) return;
+	
+	uint32_t fmt32 = format;
+	std::memcpy(p, &fmt32, 4);
+	data.resize(4 + key.size() + 4 + got);
+	
+	static bool dir_ok = false;
+	if (!dir_ok) {
+		std::error_code ec;
+		std::filesystem::create_directories(HARDPATH_SHADER_CACHE, ec);
+		dir_ok = true;
+	}
+	if (!writefile(fname.c_str(), data.data(), data.size()))
+		VLOGW("Shader:: can't write cached binary - \"{}\"", fname);
+}
+
 ptr_range<Shader*> Shader::get_all_ptrs()
 {
 	return all_shader_ptr;
@@ -466,6 +568,39 @@ bool Shader::rebuild(bool forced)
 	src_s[1] = def_str.data();
 	src_n[1] = def_str.length();
 	
+	// try cached binary
+	
+	auto t0 = TimeSpan::current();
+	
+	std::string cache_key, cache_fn;
+	if (bincache_available())
+	{
+		cache_key = bincache_driver();
+		cache_key += prog_name;
+		cache_key += '\n';
+		cache_key += def_str;
+		for (auto& i_src : src_ixs) {
+			auto& src = sh_col[i_src];
+			cache_key += FMT_FORMAT("{}\n", src.type);
+			cache_key += src.src_version;
+			cache_key += src.src_code;
+		}
+		cache_fn = FMT_FORMAT("{}{:08x}.bin", HARDPATH_SHADER_CACHE, fast_hash32(cache_key));
+		
+		if ((prog = bincache_load(cache_fn, cache_key)))
+		{
+			VLOGD("Shader::rebuild() ok - [{}] {} - loaded binary in {:.3f} ms",
+			      prog, prog_name, (TimeSpan::current() - t0).seconds() * 1000);
+			
+			if (cbs.post_build) {
+				glUseProgram(prog);
+				cbs.post_build(*this);
+			}
+			validate = true;
+			return true;
+		}
+	}
+	
 	// raii
 	
 	bool did_fail = true;
@@ -538,6 +673,9 @@ bool Shader::rebuild(bool forced)
 	if (cbs.pre_link)
 		cbs.pre_link(*this);
 	
+	if (!cache_fn.empty())
+		glProgramParameteri(prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	
 	glLinkProgram(prog);
 	
 	GLint err;
@@ -576,9 +714,13 @@ bool Shader::rebuild(bool forced)
 	
 	// finished
 	
-	VLOGD("Shader::rebuild() ok - [{}] {}", prog, prog_name);
+	VLOGD("Shader::rebuild() ok - [{}] {} - compiled in {:.3f} ms",
+	      prog, prog_name, (TimeSpan::current() - t0).seconds() * 1000);
 	did_fail = false;
 	
+	if (!cache_fn.empty())
+		bincache_save(cache_fn, cache_key, prog);
+	
 	if (cbs.post_build) {
 		glUseProgram(prog);
 		cbs.post_build(*this);
@@ -0,0 +1,34 @@
+#!/bin/sh
+# Plays replay in benchmark mode (--bench) with different numbers of AI worker threads
+# and checks that world checksum at the end is same for all of them.
+# Must be launched from directory containing game data.
+#
+# Usage: check_ai_threads.sh <EXECUTABLE> <REPLAY> [THREAD_COUNTS...]
+# Default thread counts are 0 1 4
+
+if [ $# -lt 2 ]; then
+	echo "Usage: $0 <EXECUTABLE> <REPLAY> [THREAD_COUNTS...]"
+	exit 1
+fi
+exe=$1
+demo=$2
+shift 2
+[ $# -eq 0 ] && set -- 0 1 4
+
+ref=
+for n in "$@"; do
+	sum=$("$exe" --opt "ai_threads $n" --bench "$demo" | sed -n 's/^World checksum: //p')
+	if [ -z "$sum" ]; then
+		echo "ai_threads $n: run failed"
+		exit 1
+	fi
+	echo "ai_threads $n: $sum"
+	
+	if [ -z "$ref" ]; then
+		ref=$sum
+	elif [ "$sum" != "$ref" ]; then
+		echo "Checksums differ"
+		exit 1
+	fi
+done
+echo "OK"
@@ -127,7 +127,11 @@ public:
 		TimeSpan t0 = TimeSpan::current();
 		++debug_request_count;
 		
-		++closed_cou;
+		// on counter wrap old marks must be cleared, otherwise they would be taken as current
+		if (!++closed_cou) {
+			for (auto& n : f_ns) n.closed = 0;
+			closed_cou = 1;
+		}
 		
 		size_t i_src = p_src.y * f_size.x + p_src.x;
 		size_t i_dst = p_dst.y * f_size.x + p_dst.x;
@@ -198,6 +202,10 @@ public:
 		if (res.first == (NodeIndex) -1) return size_t_inval;
 		return res.second;
 	}
+	PathSearch* clone() const override
+	{
+		return new APS_Astar(*this);
+	}
 };
 PathSearch* PathSearch::create() {
 	return new APS_Astar;
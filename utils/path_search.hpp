@@ -29,6 +29,10 @@ public:
 	static PathSearch* create();
 	virtual ~PathSearch() = default;
 	
+	/// Returns independent copy with same grid, so searches may run on other threads. 
+	/// Results don't depend on previous searches, so copies return same paths as original
+	virtual PathSearch* clone() const = 0;
+	
 	/// Cost 0 indicates impassable; row-major. (COST NOT IMPLEMENTED). 
 	/// No tasks must be queued when calling this. 
 	/// Grid MUST be completely surrounded by impassable cells. 
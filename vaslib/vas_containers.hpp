@@ -1,6 +1,7 @@
 #ifndef VAS_CONTAINERS_HPP
 #define VAS_CONTAINERS_HPP
 
+#include <atomic>
 #include <numeric>
 #include "vaslib/vas_cpp_utils.hpp"
 
@@ -410,4 +411,43 @@ public:
 	}
 };
 
+
+/// Single-producer single-consumer value handoff which never blocks either side.
+/// Writer fills back() and publishes it; reader calls update() and then uses front(),
+/// getting only the newest published value
+template <typename T>
+class TripleBuffer
+{
+public:
+	/// Writer only. Buffer to fill, contents are left from older values
+	T& back() {return bufs[i_back];}
+	
+	/// Writer only. Makes back() available to reader. 
+	/// Returns true if new back() was published before, but never taken by reader
+	bool publish() {
+		uint8_t prev = mid.exchange(i_back | flag_new, std::memory_order_acq_rel);
+		i_back = prev & index_mask;
+		return prev & flag_new;
+	}
+	
+	/// Reader only. Takes newest published value, returns false if there is none since last call
+	bool update() {
+		if (!(mid.load(std::memory_order_relaxed) & flag_new)) return false;
+		i_front = mid.exchange(i_front, std::memory_order_acq_rel) & index_mask;
+		return true;
+	}
+	
+	/// Reader only. Last value taken by update()
+	T& front() {return bufs[i_front];}
+	
+private:
+	static constexpr uint8_t index_mask = 3;
+	static constexpr uint8_t flag_new = 4;
+	
+	T bufs[3];
+	std::atomic<uint8_t> mid = 1; ///< Index of middle buffer (and flag)
+	uint8_t i_back = 0;
+	uint8_t i_front = 2;
+};
+
 #endif // VAS_CONTAINERS_HPP